@@ -0,0 +1,310 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include "sciod/NeuralNet.hpp"
+#include "sciod/QuantizedNet.hpp"
+#include "sciod/HalfNet.hpp"
+#include "sciod/FixedNet.hpp"
+#include "sciod/InferenceQueue.hpp"
+
+using namespace std;
+using namespace sciod;
+
+/*
+ * Microbenchmarks for inference and training across a grid of topologies
+ * Usage: bench [--quick] [--json FILE]
+ */
+
+struct Topology
+{
+	int inputs, hidden, hiddenLayers, outputs;
+};
+
+struct Result
+{
+	string name;
+	Topology topology;
+	size_t batchSize;
+	double nsPerOp, samplesPerSec, gflops;
+};
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Repeats op until minSeconds have passed and returns seconds per call
+ */
+static double timeOp(const function<void()> &op, double minSeconds)
+{
+	op(); // Warm up caches and lazy initialization
+	long iterations = 1;
+	while (1)
+	{
+		auto start = chrono::steady_clock::now();
+		for (long i = 0; i < iterations; ++i)
+			op();
+		double elapsed = secondsSince(start);
+		if (elapsed >= minSeconds)
+			return elapsed / iterations;
+		iterations = elapsed > 0 ? max(iterations * 2, long(iterations * minSeconds / elapsed * 1.2)) : iterations * 10;
+	}
+}
+
+// Multiply-adds in one forward pass of a single sample
+static double forwardFlops(const Topology &t)
+{
+	double weights = double(t.inputs) * t.hidden + double(t.hidden) * t.hidden * (t.hiddenLayers - 1) + double(t.hidden) * t.outputs;
+	return 2 * weights;
+}
+
+static string topologyStr(const Topology &t)
+{
+	stringstream ss;
+	ss << t.inputs << "-" << t.hidden << "x" << t.hiddenLayers << "-" << t.outputs;
+	return ss.str();
+}
+
+static vector<FloatVecIO> makeSamples(const Topology &t, size_t numSamples)
+{
+	vector<FloatVecIO> samples;
+	for (size_t i = 0; i < numSamples; ++i)
+	{
+		FloatVec in(t.inputs), out(t.outputs);
+		for (auto &j : in)
+			j = float(rand()) / RAND_MAX;
+		for (auto &j : out)
+			j = float(rand()) / RAND_MAX;
+		samples.emplace_back(in, out);
+	}
+	return samples;
+}
+
+static void addResult(vector<Result> &results, const string &name, const Topology &t,
+					size_t batchSize, double secondsPerOp, double samplesPerOp, double flopsPerOp)
+{
+	Result res = {name, t, batchSize, secondsPerOp * 1e9, samplesPerOp / secondsPerOp, flopsPerOp / secondsPerOp * 1e-9};
+	results.push_back(res);
+	printf("%-20s %-16s %6zu %14.1f %14.0f %10.3f\n", name.c_str(), topologyStr(t).c_str(),
+		batchSize, res.nsPerOp, res.samplesPerSec, res.gflops);
+	fflush(stdout);
+}
+
+static void benchTopology(const Topology &t, const vector<size_t> &batchSizes, double minSeconds, vector<Result> &results)
+{
+	NeuralNet net(t.inputs, t.hidden, t.hiddenLayers, t.outputs);
+	net.randomize();
+	const double flops = forwardFlops(t);
+	const size_t maxBatch = batchSizes.back();
+	auto samples = makeSamples(t, maxBatch);
+	const FloatVec &in = samples[0].in;
+
+	volatile float sink = 0.f;
+	double sec = timeOp([&] { sink = net.calcProb(in)[0]; }, minSeconds);
+	addResult(results, "calcProb", t, 1, sec, 1, flops);
+
+	sec = timeOp([&] { sink = net.calcProbFull(in).back()[0]; }, minSeconds);
+	addResult(results, "calcProbFull", t, 1, sec, 1, flops);
+
+	Workspace workspace(net, maxBatch);
+	FloatVec out(maxBatch * t.outputs);
+	sec = timeOp([&] { net.calcProb(in.data(), out.data(), workspace); }, minSeconds);
+	addResult(results, "calcProb/workspace", t, 1, sec, 1, flops);
+
+	FloatVec rows;
+	for (auto &i : samples)
+		rows.insert(rows.end(), i.in.begin(), i.in.end());
+	for (size_t batch : batchSizes)
+	{
+		sec = timeOp([&] { net.calcProbBatch(rows.data(), batch, out.data(), workspace); }, minSeconds);
+		addResult(results, "calcProbBatch", t, batch, sec, batch, flops * batch);
+	}
+
+	QuantizedNet quantized;
+	quantized.quantize(net, Dataset(samples));
+	for (size_t batch : batchSizes)
+	{
+		sec = timeOp([&] { quantized.calcProbBatch(rows.data(), batch, out.data()); }, minSeconds);
+		addResult(results, "int8 calcProbBatch", t, batch, sec, batch, flops * batch);
+	}
+
+	HalfNet half(net, WeightType::F16);
+	for (size_t batch : batchSizes)
+	{
+		sec = timeOp([&] { half.calcProbBatch(rows.data(), batch, out.data()); }, minSeconds);
+		addResult(results, "f16 calcProbBatch", t, batch, sec, batch, flops * batch);
+	}
+
+	// Concurrent single sample callers, coalesced by the queue. The caller
+	// threads are started once; each timed round wakes them to send a burst
+	const size_t numCallers = 8, requestsPerCaller = 64;
+	QueueConfig queueConfig;
+	queueConfig.maxBatchSize = numCallers;
+	InferenceQueue queue(make_shared<Model>(net), queueConfig);
+	mutex roundMutex;
+	condition_variable roundChanged;
+	long round = 0;
+	size_t numFinished = 0;
+	bool stopping = false;
+	vector<thread> callers;
+	for (size_t c = 0; c < numCallers; ++c)
+		callers.emplace_back([&]
+		{
+			long lastRound = 0;
+			while (1)
+			{
+				{
+					unique_lock<mutex> lock(roundMutex);
+					roundChanged.wait(lock, [&] { return round != lastRound || stopping; });
+					if (stopping)
+						return;
+					lastRound = round;
+				}
+				for (size_t i = 0; i < requestsPerCaller; ++i)
+					queue.submit(in).get();
+				{
+					lock_guard<mutex> lock(roundMutex);
+					++numFinished;
+				}
+				roundChanged.notify_all();
+			}
+		});
+	sec = timeOp([&]
+	{
+		unique_lock<mutex> lock(roundMutex);
+		numFinished = 0;
+		++round;
+		roundChanged.notify_all();
+		roundChanged.wait(lock, [&] { return numFinished == numCallers; });
+	}, minSeconds);
+	{
+		lock_guard<mutex> lock(roundMutex);
+		stopping = true;
+	}
+	roundChanged.notify_all();
+	for (auto &caller : callers)
+		caller.join();
+	const size_t numRequests = numCallers * requestsPerCaller;
+	addResult(results, "queued calcProb", t, numCallers, sec / numRequests, 1, flops);
+
+	// Training costs roughly three forward passes: forward, deltas and weight derivatives
+	// The samples are converted once, and every call runs epochsPerCall epochs so
+	// the per call setup is amortized. Random targets keep the error above zero
+	const Dataset data(samples);
+	const long epochsPerCall = 8;
+	TrainConfig config;
+	config.maxError = 0.f;
+	config.maxEpochs = epochsPerCall;
+	config.learningRate = 0.01f;
+	config.resolveConflicts = false;
+	sec = timeOp([&] { net.backPropagate(data, config); }, minSeconds) / epochsPerCall;
+	addResult(results, "backPropagateStep", t, 1, sec / data.size(), 1, 3 * flops);
+
+	for (size_t batch : batchSizes)
+	{
+		if (batch == 1)
+			continue;
+		config.batchSize = batch;
+		sec = timeOp([&] { net.backPropagate(data, config); }, minSeconds) / epochsPerCall;
+		addResult(results, "backPropagate epoch", t, batch, sec, data.size(), 3 * flops * data.size());
+	}
+	(void)sink;
+}
+
+/*
+ * Same forward and training rows for a FixedNet of topology t
+ */
+template <size_t... Sizes>
+static void benchFixed(const Topology &t, double minSeconds, vector<Result> &results)
+{
+	FixedNet<Sizes...> net;
+	net.randomize();
+	const double flops = forwardFlops(t);
+	auto samples = makeSamples(t, 256);
+	typename FixedNet<Sizes...>::Outputs out;
+
+	volatile float sink = 0.f;
+	double sec = timeOp([&] { net.calcProb(samples[0].in.data(), out.data()); sink = out[0]; }, minSeconds);
+	addResult(results, "fixed calcProb", t, 1, sec, 1, flops);
+
+	sec = timeOp([&]
+	{
+		for (auto &i : samples)
+			net.backPropagateStep(i.in.data(), i.out.data(), 0.01f);
+	}, minSeconds);
+	addResult(results, "fixed backPropStep", t, 1, sec / samples.size(), 1, 3 * flops);
+	(void)sink;
+}
+
+static string toJson(const vector<Result> &results)
+{
+	stringstream ss;
+	ss << "[\n";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Result &r = results[i];
+		ss << "  {\"name\": \"" << r.name << "\", \"inputs\": " << r.topology.inputs
+		<< ", \"hidden\": " << r.topology.hidden << ", \"hiddenLayers\": " << r.topology.hiddenLayers
+		<< ", \"outputs\": " << r.topology.outputs << ", \"batchSize\": " << r.batchSize
+		<< ", \"nsPerOp\": " << r.nsPerOp << ", \"samplesPerSec\": " << r.samplesPerSec
+		<< ", \"gflops\": " << r.gflops << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	ss << "]\n";
+	return ss.str();
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = false;
+	string jsonFile;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--quick") == 0)
+			quick = true;
+		else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			jsonFile = argv[++i];
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--quick] [--json FILE]" << endl;
+			return 1;
+		}
+	}
+
+	const vector<Topology> topologies = quick ?
+		vector<Topology>{{2, 5, 1, 1}, {32, 64, 2, 8}} :
+		vector<Topology>{{2, 5, 1, 1}, {32, 64, 2, 8}, {128, 256, 2, 10}, {784, 256, 3, 10}};
+	const vector<size_t> batchSizes = quick ? vector<size_t>{1, 32} : vector<size_t>{1, 32, 256};
+	const double minSeconds = quick ? 0.02 : 0.2;
+
+	srand(1);
+	vector<Result> results;
+	printf("%-20s %-16s %6s %14s %14s %10s\n", "benchmark", "topology", "batch", "ns/op", "samples/s", "GFLOP/s");
+	for (auto &t : topologies)
+		benchTopology(t, batchSizes, minSeconds, results);
+	benchFixed<2, 5, 1>(topologies[0], minSeconds, results);
+	benchFixed<32, 64, 64, 8>(topologies[1], minSeconds, results);
+
+	if (!jsonFile.empty())
+	{
+		ofstream file(jsonFile);
+		file << toJson(results);
+		if (!file)
+		{
+			cerr << "Could not write " << jsonFile << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdlib>
+
+namespace sciod
+{
+	float squash(float val);
+
+	/*
+	 * How the logistic sigmoid is evaluated
+	 * Fast uses a polynomial approximation of exp with a
+	 * max absolute error in the sigmoid output below 5e-6
+	 */
+	enum class SigmoidMode
+	{
+		Exact,
+		Fast
+	};
+
+	// Squashes every value of a buffer in place
+	void squash(float *vals, size_t n, SigmoidMode mode = SigmoidMode::Exact);
+
+	/*
+	 * Function applied to the weighted sum of every node in a layer
+	 * LeakyRelu passes negative sums through scaled by leakyReluSlope
+	 * Softmax is only valid on the output layer, where it is
+	 * trained against a cross-entropy loss instead of squared error
+	 */
+	enum class Activation
+	{
+		Sigmoid,
+		Tanh,
+		Relu,
+		LeakyRelu,
+		Linear,
+		Softmax
+	};
+
+	const float leakyReluSlope = 0.01f;
+
+	/*
+	 * Applies the activation in place to numRows rows of width sums
+	 * SigmoidMode also selects how Tanh is evaluated
+	 */
+	void activate(Activation act, float *vals, size_t numRows, size_t width, SigmoidMode mode = SigmoidMode::Exact);
+
+	/*
+	 * Multiplies deltas by the derivative of the activation,
+	 * expressed in terms of the activation's outputs
+	 */
+	void activationDeriv(Activation act, const float *outputs, float *deltas, size_t n);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include "sciod/Dataset.hpp"
+
+namespace sciod
+{
+	/*
+	 * Supplies training samples a chunk at a time so a data set never
+	 * has to fit in memory as a whole
+	 */
+	class DataSource
+	{
+	public:
+		virtual ~DataSource() = default;
+
+		// Replaces the contents of rows with up to maxRows samples
+		// Returns the number read, 0 once the data is exhausted
+		virtual size_t read(Dataset &rows, size_t maxRows) = 0;
+
+		// Starts again from the first sample
+		virtual void rewind() = 0;
+	};
+
+	/*
+	 * Zero based column indices of a delimited text file
+	 * Columns not listed are ignored
+	 */
+	struct ColumnSpec
+	{
+		std::vector<size_t> inputs;
+		std::vector<size_t> outputs;
+	};
+
+	/*
+	 * Streams samples from a CSV or TSV file (delimiter '\t')
+	 * Blank lines are skipped. A row with a missing or non numeric
+	 * selected column throws std::runtime_error naming the line
+	 */
+	class CsvReader : public DataSource
+	{
+	public:
+		CsvReader(const ColumnSpec &columns, char delimiter = ',', bool hasHeader = false);
+		bool open(const std::string &filename);
+		size_t read(Dataset &rows, size_t maxRows) override;
+		void rewind() override;
+
+	private:
+		void parseLine(float *inputVals, float *outputVals);
+
+		ColumnSpec columns;
+		char delimiter;
+		bool hasHeader;
+		std::string filename;
+		std::ifstream file;
+		std::string line;
+		std::vector<const char *> fields;
+		size_t lineNum = 0;
+	};
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include "sciod/FloatVec.hpp"
+
+namespace sciod
+{
+	/*
+	 * Samples stored as two contiguous row-major matrices, one of inputs
+	 * and one of outputs, instead of two heap blocks per sample
+	 * Row pointers stay valid until the dataset grows past its capacity
+	 */
+	class Dataset
+	{
+	public:
+		Dataset() = default;
+		Dataset(size_t numInputs, size_t numOutputs);
+		explicit Dataset(const std::vector<FloatVecIO> &vals);
+
+		size_t size() const;
+		bool empty() const;
+		size_t getNumInputs() const;
+		size_t getNumOutputs() const;
+		void reserve(size_t numRows);
+		void resize(size_t numRows);
+		void clear();
+		void addRow(const float *inputVals, const float *outputVals);
+		void addRow(const FloatVec &inputVals, const FloatVec &outputVals);
+
+		float *getInputs(size_t row);
+		const float *getInputs(size_t row) const;
+		float *getOutputs(size_t row);
+		const float *getOutputs(size_t row) const;
+
+		// The whole matrices, size() rows back to back
+		const float *getInputs() const;
+		const float *getOutputs() const;
+
+		// Fills indices with every row index in a random order (uses rand)
+		void shuffledIndices(std::vector<size_t> &indices) const;
+
+	private:
+		size_t numInputs = 0, numOutputs = 0, numRows = 0;
+		AlignedFloatVec inputs, outputs;
+	};
+}
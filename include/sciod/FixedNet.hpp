@@ -0,0 +1,383 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+#include "sciod/NeuralNet.hpp"
+
+namespace sciod
+{
+	namespace detail
+	{
+		template <size_t First, size_t... Rest>
+		struct FirstSize
+		{
+			static constexpr size_t value = First;
+		};
+
+		template <size_t... Sizes>
+		struct LastSize;
+
+		template <size_t Last>
+		struct LastSize<Last>
+		{
+			static constexpr size_t value = Last;
+		};
+
+		template <size_t First, size_t... Rest>
+		struct LastSize<First, Rest...>
+		{
+			static constexpr size_t value = LastSize<Rest...>::value;
+		};
+
+		/*
+		 * Weights laid out like Layer: Out rows of In weights each
+		 */
+		template <size_t In, size_t Out>
+		struct FixedLayer
+		{
+			std::array<float, In * Out> weights;
+			std::array<float, Out> biases;
+			Activation activation;
+
+			FixedLayer() : activation(Activation::Sigmoid)
+			{
+				weights.fill(0.f);
+				biases.fill(0.f);
+			}
+
+			void forward(const float *inputVals, float *outputVals, SigmoidMode mode) const
+			{
+				for (size_t dest = 0; dest < Out; ++dest)
+				{
+					const float *row = weights.data() + dest * In;
+					float sum = biases[dest];
+					for (size_t src = 0; src < In; ++src)
+						sum += row[src] * inputVals[src];
+					outputVals[dest] = sum;
+				}
+				activate(activation, outputVals, 1, Out, mode);
+			}
+
+			/*
+			 * Same single pass over each weight row as NeuralNet: the old
+			 * weights feed chainSums (if given) as the new ones are written
+			 */
+			void update(const float *inputVals, const float *deltas, float learningRate, float *chainSums)
+			{
+				if (chainSums)
+					std::fill(chainSums, chainSums + In, 0.f);
+				for (size_t dest = 0; dest < Out; ++dest)
+				{
+					float *row = weights.data() + dest * In;
+					const float step = -learningRate * deltas[dest];
+					if (chainSums)
+					{
+						for (size_t src = 0; src < In; ++src)
+						{
+							chainSums[src] += deltas[dest] * row[src];
+							row[src] += step * inputVals[src];
+						}
+					}
+					else
+					{
+						for (size_t src = 0; src < In; ++src)
+							row[src] += step * inputVals[src];
+					}
+					biases[dest] -= deltas[dest] * learningRate * defaultBiasScale;
+				}
+			}
+
+			void copyFrom(const Layer &layer)
+			{
+				activation = layer.getActivation();
+				std::copy(layer.getWeights(), layer.getWeights() + In * Out, weights.begin());
+				std::copy(layer.getBiases(), layer.getBiases() + Out, biases.begin());
+			}
+
+			void copyTo(Layer &layer) const
+			{
+				layer.setActivation(activation);
+				std::copy(weights.begin(), weights.end(), layer.getWeights());
+				std::copy(biases.begin(), biases.end(), layer.getBiases());
+			}
+		};
+
+		/*
+		 * One layer followed by the rest of the network, so every
+		 * buffer between layers is a std::array of known size
+		 */
+		template <size_t... Sizes>
+		struct FixedLayers;
+
+		template <size_t In, size_t Out>
+		struct FixedLayers<In, Out>
+		{
+			FixedLayer<In, Out> layer;
+
+			void forward(const float *inputVals, float *outputVals, SigmoidMode mode) const
+			{
+				layer.forward(inputVals, outputVals, mode);
+			}
+
+			// Same loss as NeuralNet::calcOutputDeltas. Returns initial error
+			float train(const float *inputVals, const float *correctVals, float learningRate,
+						SigmoidMode mode, float *chainSums)
+			{
+				std::array<float, Out> outputVals, deltas;
+				layer.forward(inputVals, outputVals.data(), mode);
+
+				float error = 0.f;
+				for (size_t i = 0; i < Out; ++i)
+				{
+					float diff = outputVals[i] - correctVals[i];
+					deltas[i] = diff;
+					if (layer.activation == Activation::Softmax)
+						error -= correctVals[i] * std::log(std::max(outputVals[i], 1e-30f));
+					else
+						error += diff * diff / 2.f;
+				}
+
+				// Softmax and cross-entropy derivatives cancel down to diff
+				if (layer.activation != Activation::Softmax)
+					activationDeriv(layer.activation, outputVals.data(), deltas.data(), Out);
+				layer.update(inputVals, deltas.data(), learningRate, chainSums);
+				return error;
+			}
+
+			void setActivation(size_t layerId, Activation act)
+			{
+				assert(layerId == 0);
+				layer.activation = act;
+			}
+
+			Activation getActivation(size_t layerId) const
+			{
+				assert(layerId == 0);
+				return layer.activation;
+			}
+
+			void randomize()
+			{
+				for (float &weight : layer.weights)
+					weight = -1.f + (2.f * rand()) / RAND_MAX;
+			}
+
+			void copyFrom(const NeuralNet &net, size_t layerId)
+			{
+				layer.copyFrom(net.getLayer(layerId));
+			}
+
+			void copyTo(NeuralNet &net, size_t layerId) const
+			{
+				layer.copyTo(net.getLayer(layerId));
+			}
+		};
+
+		template <size_t In, size_t Next, size_t... Rest>
+		struct FixedLayers<In, Next, Rest...>
+		{
+			FixedLayer<In, Next> layer;
+			FixedLayers<Next, Rest...> rest;
+
+			void forward(const float *inputVals, float *outputVals, SigmoidMode mode) const
+			{
+				std::array<float, Next> hidden;
+				layer.forward(inputVals, hidden.data(), mode);
+				rest.forward(hidden.data(), outputVals, mode);
+			}
+
+			// Later layers are adjusted first, as in NeuralNet::backPropagateStep
+			float train(const float *inputVals, const float *correctVals, float learningRate,
+						SigmoidMode mode, float *chainSums)
+			{
+				std::array<float, Next> hidden, deltas;
+				layer.forward(inputVals, hidden.data(), mode);
+				float error = rest.train(hidden.data(), correctVals, learningRate, mode, deltas.data());
+				activationDeriv(layer.activation, hidden.data(), deltas.data(), Next);
+				layer.update(inputVals, deltas.data(), learningRate, chainSums);
+				return error;
+			}
+
+			void setActivation(size_t layerId, Activation act)
+			{
+				if (layerId == 0)
+					layer.activation = act;
+				else
+					rest.setActivation(layerId - 1, act);
+			}
+
+			Activation getActivation(size_t layerId) const
+			{
+				return layerId == 0 ? layer.activation : rest.getActivation(layerId - 1);
+			}
+
+			void randomize()
+			{
+				for (float &weight : layer.weights)
+					weight = -1.f + (2.f * rand()) / RAND_MAX;
+				rest.randomize();
+			}
+
+			void copyFrom(const NeuralNet &net, size_t layerId)
+			{
+				layer.copyFrom(net.getLayer(layerId));
+				rest.copyFrom(net, layerId + 1);
+			}
+
+			void copyTo(NeuralNet &net, size_t layerId) const
+			{
+				layer.copyTo(net.getLayer(layerId));
+				rest.copyTo(net, layerId + 1);
+			}
+		};
+	}
+
+	/*
+	 * Network whose topology is fixed at compile time, e.g.
+	 * FixedNet<2, 5, 1> for 2 inputs, 5 hidden nodes and 1 output
+	 *
+	 * Every layer size is a constant, so the dot products and weight
+	 * updates compile to fixed length loops with no heap allocation.
+	 * Activations still go through activate(), and with it the dispatched
+	 * sigmoid kernels. Meant for tiny nets where allocation dominates;
+	 * weights live inside the object, so large topologies belong in NeuralNet
+	 *
+	 * Trains and evaluates like NeuralNet with online updates and the
+	 * default bias scale, and converts to and from a NeuralNet of the
+	 * same topology
+	 */
+	template <size_t... Sizes>
+	class FixedNet
+	{
+		static_assert(sizeof...(Sizes) >= 2, "FixedNet needs at least an input and an output size");
+
+	public:
+		static constexpr size_t numInputs = detail::FirstSize<Sizes...>::value;
+		static constexpr size_t numOutputs = detail::LastSize<Sizes...>::value;
+		static constexpr size_t numLayers = sizeof...(Sizes) - 1;
+		using Inputs = std::array<float, numInputs>;
+		using Outputs = std::array<float, numOutputs>;
+
+		FixedNet() = default;
+
+		explicit FixedNet(const NeuralNet &net)
+		{
+			bool converted = fromNeuralNet(net);
+			assert(converted);
+			(void)converted;
+		}
+
+		static std::vector<size_t> getTopology()
+		{
+			return {Sizes...};
+		}
+
+		/*
+		 * Copies net's weights, activations and sigmoid mode
+		 * Returns false and leaves the net untouched if the topologies differ
+		 */
+		bool fromNeuralNet(const NeuralNet &net)
+		{
+			if (net.getTopology() != getTopology())
+				return false;
+			layers.copyFrom(net, 0);
+			sigmoidMode = net.getSigmoidMode();
+			return true;
+		}
+
+		NeuralNet toNeuralNet() const
+		{
+			NeuralNet net(getTopology());
+			layers.copyTo(net, 0);
+			net.setSigmoidMode(sigmoidMode);
+			return net;
+		}
+
+		// Same distribution as NeuralNet::randomize
+		void randomize()
+		{
+			layers.randomize();
+		}
+
+		void setActivation(size_t layerId, Activation act)
+		{
+			assert(layerId < numLayers);
+			layers.setActivation(layerId, act);
+		}
+
+		Activation getActivation(size_t layerId) const
+		{
+			assert(layerId < numLayers);
+			return layers.getActivation(layerId);
+		}
+
+		void setSigmoidMode(SigmoidMode mode)
+		{
+			sigmoidMode = mode;
+		}
+
+		SigmoidMode getSigmoidMode() const
+		{
+			return sigmoidMode;
+		}
+
+		Outputs calcProb(const Inputs &inputVals) const
+		{
+			Outputs outputVals;
+			layers.forward(inputVals.data(), outputVals.data(), sigmoidMode);
+			return outputVals;
+		}
+
+		void calcProb(const float *inputVals, float *outputVals) const
+		{
+			layers.forward(inputVals, outputVals, sigmoidMode);
+		}
+
+		// One online update. Returns initial error
+		float backPropagateStep(const float *inputVals, const float *outputVals, float learningRate)
+		{
+			return layers.train(inputVals, outputVals, learningRate, sigmoidMode, nullptr);
+		}
+
+		/*
+		 * Online training with the same stopping rule as NeuralNet
+		 * Samples are used in order; conflicting samples are not merged
+		 */
+		BackPropResult backPropagate(const Dataset &data, float maxError = 0.001f, float learningRate = 0.5f)
+		{
+			assert(data.getNumInputs() == numInputs && data.getNumOutputs() == numOutputs);
+			const float minDiff = 0.000001f;
+			const float avErrWeight = 1.f - 5.f * maxError;
+			float avErr = 0.f;
+			long epoch = 0;
+			while (1)
+			{
+				++epoch;
+				float err = 0.f;
+				for (size_t i = 0; i < data.size(); ++i)
+					err += backPropagateStep(data.getInputs(i), data.getOutputs(i), learningRate);
+
+				if (err < maxError || std::abs(avErr - err) < minDiff)
+					return {epoch, err, 0.f, epoch};
+				avErr = avErrWeight * avErr + (1 - avErrWeight) * err;
+			}
+		}
+
+	private:
+		detail::FixedLayers<Sizes...> layers;
+		SigmoidMode sigmoidMode = SigmoidMode::Exact;
+	};
+
+	template <size_t... Sizes>
+	constexpr size_t FixedNet<Sizes...>::numInputs;
+
+	template <size_t... Sizes>
+	constexpr size_t FixedNet<Sizes...>::numOutputs;
+
+	template <size_t... Sizes>
+	constexpr size_t FixedNet<Sizes...>::numLayers;
+}
@@ -1,16 +1,77 @@
 #pragma once
 
 #include <vector>
+#include <cstdlib>
+#include <new>
 
 namespace sciod
 {
+	/*
+	 * Allocator returning memory aligned to a cache line
+	 * so weight rows can be streamed with aligned vector loads
+	 */
+	template <typename T, size_t Align = 64>
+	struct AlignedAllocator
+	{
+		using value_type = T;
+
+		template <typename U>
+		struct rebind
+		{
+			using other = AlignedAllocator<U, Align>;
+		};
+
+		AlignedAllocator() = default;
+
+		template <typename U>
+		AlignedAllocator(const AlignedAllocator<U, Align> &) { }
+
+		T *allocate(size_t n)
+		{
+			void *ptr = nullptr;
+			if (posix_memalign(&ptr, Align, n * sizeof(T) + (n == 0)) != 0)
+				throw std::bad_alloc();
+			return static_cast<T*>(ptr);
+		}
+
+		void deallocate(T *ptr, size_t)
+		{
+			free(ptr);
+		}
+	};
+
+	template <typename T, typename U, size_t Align>
+	bool operator==(const AlignedAllocator<T, Align> &, const AlignedAllocator<U, Align> &)
+	{
+		return true;
+	}
+
+	template <typename T, typename U, size_t Align>
+	bool operator!=(const AlignedAllocator<T, Align> &, const AlignedAllocator<U, Align> &)
+	{
+		return false;
+	}
+
+	/*
+	 * Storage format of weights: 32 bit float, IEEE half precision,
+	 * or bfloat16 (the top 16 bits of a float)
+	 */
+	enum class WeightType
+	{
+		F32,
+		F16,
+		BF16
+	};
+
 	using FloatVec = std::vector<float>;
 	using FloatVec2D = std::vector<FloatVec>;
+	using AlignedFloatVec = std::vector<float, AlignedAllocator<float>>;
 
 	FloatVec FloatVecSingle(float a);
 
 	struct FloatVecIO
 	{
+		FloatVecIO() = default;
 		FloatVecIO(const FloatVec &in, const FloatVec &out);
 		FloatVec in, out;
 	};
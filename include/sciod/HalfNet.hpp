@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "sciod/NeuralNet.hpp"
+
+namespace sciod
+{
+	/*
+	 * Inference only copy of a NeuralNet with weights stored in 16 bits
+	 * (F16 or BF16), widened to float inside the forward kernels
+	 * Halves the weight memory and the bandwidth needed to stream it;
+	 * biases, activations and arithmetic stay in float
+	 */
+	class HalfNet
+	{
+	public:
+		HalfNet() = default;
+		HalfNet(const NeuralNet &net, WeightType type = WeightType::F16);
+		void convert(const NeuralNet &net, WeightType type = WeightType::F16);
+		bool save(const std::string &filename) const;
+		bool load(const std::string &filename);
+		WeightType getWeightType() const;
+		size_t getNumInputs() const;
+		size_t getNumOutputs() const;
+		size_t getNumLayers() const;
+		FloatVec calcProb(const FloatVec &inputVals) const;
+		void calcProbBatch(const float *inputRows, size_t numRows, float *outputRows) const;
+
+	private:
+		using HalfVec = std::vector<uint16_t, AlignedAllocator<uint16_t>>;
+
+		struct HalfLayer
+		{
+			size_t prevSize, size;
+			Activation activation;
+			HalfVec weights;
+			AlignedFloatVec biases;
+		};
+
+		std::vector<HalfLayer> layers;
+		WeightType weightType = WeightType::F16;
+		SigmoidMode sigmoidMode = SigmoidMode::Exact;
+	};
+}
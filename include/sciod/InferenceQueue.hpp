@@ -0,0 +1,85 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include "sciod/Model.hpp"
+
+namespace sciod
+{
+	struct QueueConfig
+	{
+		// Most requests run through the net together
+		size_t maxBatchSize = 64;
+
+		// Longest a request waits for others to join its batch
+		long maxWaitMicros = 200;
+	};
+
+	/*
+	 * Collects single sample requests from any number of threads and
+	 * runs them through the net in batches, so that concurrent callers
+	 * share one matrix-matrix forward pass instead of each running
+	 * their own vector pass
+	 *
+	 * A batch runs once maxBatchSize requests are waiting or the oldest
+	 * has waited maxWaitMicros, whichever comes first. Batches run on a
+	 * thread owned by the queue, which finishes the remaining requests
+	 * when the queue is destroyed
+	 */
+	class InferenceQueue
+	{
+	public:
+		InferenceQueue(ModelPtr model, const QueueConfig &config = QueueConfig());
+
+		// Every batch uses the latest model published by trainer,
+		// which must outlive the queue
+		InferenceQueue(const Trainer &trainer, const QueueConfig &config = QueueConfig());
+		~InferenceQueue();
+		InferenceQueue(const InferenceQueue &) = delete;
+		InferenceQueue &operator=(const InferenceQueue &) = delete;
+
+		// Inputs must have getNumInputs() values
+		std::future<FloatVec> submit(const FloatVec &inputVals);
+		std::future<FloatVec> submit(const float *inputVals);
+		size_t getNumInputs() const;
+
+		// Batches run so far
+		size_t getNumBatches() const;
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		struct Request
+		{
+			FloatVec inputVals;
+			std::promise<FloatVec> result;
+			Clock::time_point arrival;
+		};
+
+		void workerLoop();
+		void runBatch(std::vector<Request> &batch);
+
+		QueueConfig config;
+		std::function<ModelPtr()> getModel;
+		size_t numInputs;
+
+		mutable std::mutex mutex;
+		std::condition_variable wakeCond;
+		std::deque<Request> pending;
+		size_t numBatches = 0;
+		bool stopping = false;
+
+		// Only touched by the worker thread
+		Workspace workspace;
+		size_t workspaceWidth = 0;
+		AlignedFloatVec inputRows, outputRows;
+
+		// Started last, once everything it uses is constructed
+		std::thread worker;
+	};
+}
@@ -2,25 +2,71 @@
 
 #include <vector>
 #include <cstdlib>
+#include <memory>
 
-#include "sciod/Node.hpp"
+#include "sciod/FloatVec.hpp"
+#include "sciod/Activation.hpp"
 
 namespace sciod
 {
+	class Layer;
 
+	/*
+	 * Accumulated derivatives of the error with respect to
+	 * each weight and bias of a layer, in the same layout
+	 */
+	struct LayerGradient
+	{
+		LayerGradient(const Layer &layer);
+		void clear();
+		void add(const LayerGradient &other);
+		AlignedFloatVec weights, biases;
+	};
+
+	/*
+	 * Weights connecting the previous row of nodes to this one
+	 * Stored as one contiguous row-major matrix: each destination node
+	 * owns a row of numPrevNodes() weights, followed by the next node's row
+	 *
+	 * The matrix normally lives in the layer's own storage, but can also be
+	 * external memory (ie. a mapped model file) used in place. Copies always
+	 * get their own storage
+	 */
 	class Layer
 	{
 	public:
-		Layer(int prevSize, int size);
+		Layer(int prevSize, int size, Activation activation = Activation::Sigmoid);
+		Layer(int prevSize, int size, Activation activation, float *weights, float *biases,
+			std::shared_ptr<void> mapping);
+		Layer(const Layer &other);
+		Layer(Layer &&other) = default;
+		Layer &operator=(const Layer &other);
+		Layer &operator=(Layer &&other) = default;
 		size_t numNodes() const;
 		size_t numPrevNodes() const;
 		void randomize();
+		Activation getActivation() const;
+		void setActivation(Activation act);
 		float getBias(size_t id) const;
 		void updateBiases(const FloatVec &outputs, float learningRate);
 		float &getLinkRef(size_t src, size_t dest);
 		float getLink(size_t src, size_t dest) const;
+		void applyGradient(const LayerGradient &grad, float learningRate, float biasRate);
+
+		const float *getRow(size_t dest) const;
+		float *getRow(size_t dest);
+		const float *getWeights() const;
+		float *getWeights();
+		const float *getBiases() const;
+		float *getBiases();
 
 	private:
-		std::vector<Node> nodes;
+		size_t prevSize, size;
+		Activation activation;
+		AlignedFloatVec weightStorage, biasStorage;
+
+		// Point into the storage above, or into memory kept alive by mapping
+		float *weights, *biases;
+		std::shared_ptr<void> mapping;
 	};
 }
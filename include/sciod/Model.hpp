@@ -0,0 +1,94 @@
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include "sciod/NeuralNet.hpp"
+
+namespace sciod
+{
+	/*
+	 * Immutable snapshot of a network's weights
+	 * Nothing can change it once created, so any number of threads may
+	 * run inference on one at the same time. Each thread needs its own
+	 * Workspace for the allocation free calls
+	 */
+	class Model
+	{
+	public:
+		explicit Model(const NeuralNet &net, long version = 0);
+		explicit Model(NeuralNet &&net, long version = 0);
+		const NeuralNet &getNet() const;
+
+		// Number of snapshots published before this one by its Trainer
+		long getVersion() const;
+		size_t getNumInputs() const;
+		size_t getNumOutputs() const;
+		FloatVec calcProb(const FloatVec &inputVals) const;
+		FloatVec calcProbBatch(const Dataset &data) const;
+		void calcProb(const float *inputVals, float *outputVals, Workspace &workspace) const;
+		void calcProbBatch(const float *inputRows, size_t numRows, float *outputRows, Workspace &workspace) const;
+
+	private:
+		const NeuralNet net;
+		const long version;
+	};
+
+	using ModelPtr = std::shared_ptr<const Model>;
+
+	/*
+	 * Trains a network while other threads serve the latest published
+	 * copy of it (read-copy-update)
+	 *
+	 * Training runs on one thread at a time. Every publish copies the
+	 * weights into a new Model and places it in whichever of two slots
+	 * readers are not using, then makes that slot current. getModel
+	 * takes no lock: it copies the pointer out of the current slot,
+	 * retrying in the rare case that a publish retires the slot mid copy.
+	 * Only publish waits, for readers still copying from the slot it is
+	 * about to reuse. Readers keep the snapshot they hold until they ask
+	 * for a newer one; a Model is freed when its last reader lets go
+	 */
+	class Trainer
+	{
+	public:
+		explicit Trainer(const NeuralNet &net);
+
+		// The network being trained. Only for the training thread
+		NeuralNet &getNet();
+
+		// Safe to call from any thread, at any time. Never blocks
+		ModelPtr getModel() const;
+
+		// Also publish every publishInterval epochs during training. 0 only
+		// publishes once training ends
+		void setPublishInterval(long epochs);
+
+		// Train the net as NeuralNet::backPropagate does, then publish it
+		BackPropResult train(const Dataset &data, const TrainConfig &config);
+		BackPropResult train(DataSource &source, const TrainConfig &config);
+
+		// Makes the net's current weights visible to getModel
+		void publish();
+
+	private:
+		// A published model and the readers copying it right now
+		struct Slot
+		{
+			ModelPtr model;
+			std::atomic<long> readers{0};
+		};
+
+		TrainConfig publishingConfig(const TrainConfig &config);
+
+		NeuralNet net;
+		long publishInterval = 0;
+		long version = 0;
+
+		mutable Slot slots[2];
+		std::atomic<Slot *> current;
+
+		// Serializes publishers; readers never take it
+		std::mutex publishMutex;
+	};
+}
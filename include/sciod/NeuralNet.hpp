@@ -2,40 +2,280 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <memory>
 #include "sciod/Layer.hpp"
+#include "sciod/Activation.hpp"
+#include "sciod/Dataset.hpp"
+#include "sciod/DataSource.hpp"
 
 #include "sciod/FloatVec.hpp"
 
 namespace sciod
 {
-	float squash(float val);
-	
 	struct BackPropResult
 	{
 		long epoch;
+
+		// Training error of the epoch the returned weights come from
 		float error;
+
+		// Validation error of the weights training ended with,
+		// 0 without validation data
+		float validationError;
+
+		// Epoch those weights come from. Earlier than epoch when
+		// later epochs did worse on the validation data
+		long bestEpoch;
+	};
+	
+	/*
+	 * Progress of training, reported to a TrainObserver
+	 */
+	struct EpochStats
+	{
+		long epoch;
+		float loss;
+
+		// Seconds since training started
+		double wallTime;
+
+		// Throughput over the epochs since the previous report
+		double samplesPerSec;
+		float learningRate;
+	};
+
+	using TrainObserver = std::function<void(const EpochStats &)>;
+
+	class ThreadPool;
+	class Optimizer;
+	class NeuralNet;
+
+	/*
+	 * Scratch buffers for inference, sized once from a network's topology
+	 * Holds the outputs of intermediate layers for up to maxRows rows;
+	 * larger batches are processed maxRows at a time
+	 * Not safe to share between threads
+	 */
+	class Workspace
+	{
+	public:
+		Workspace() = default;
+		Workspace(const NeuralNet &net, size_t maxRows = 1);
+		size_t getMaxRows() const;
+
+	private:
+		friend class NeuralNet;
+		size_t maxRows = 0, maxWidth = 0;
+		AlignedFloatVec bufA, bufB;
+	};
+
+	/*
+	 * Rule turning gradients into weight updates
+	 * Momentum and Nesterov keep a velocity per parameter, RMSProp a
+	 * running mean of squared gradients and Adam both. RMSProp and Adam
+	 * take steps of roughly learningRate per parameter, so they want a far
+	 * smaller rate (ie. 0.001) than plain SGD
+	 *
+	 * The state stays with the net, so consecutive backPropagate calls
+	 * with the same OptimizerConfig continue where the last one stopped.
+	 * It starts over when the config or topology changes, on load and on
+	 * NeuralNet::resetOptimizer. It is copied with the net but not saved,
+	 * and NeuralNet::copyWeights and Model snapshots leave it out
+	 */
+	enum class OptimizerType
+	{
+		Sgd,
+		Momentum,
+		Nesterov,
+		RMSProp,
+		Adam
+	};
+
+	// Learning rate of the biases relative to the weights, unless configured
+	const float defaultBiasScale = 0.75f;
+
+	struct OptimizerConfig
+	{
+		OptimizerType type = OptimizerType::Sgd;
+
+		// Learning rate of the biases relative to the weights
+		float biasScale = defaultBiasScale;
+
+		// Fraction of the velocity kept each update (Momentum, Nesterov)
+		float momentum = 0.9f;
+
+		// Fraction of the mean square kept each update (RMSProp)
+		float rmsDecay = 0.9f;
+
+		// Decay of the first and second moments (Adam)
+		float beta1 = 0.9f;
+		float beta2 = 0.999f;
+
+		// Keeps RMSProp and Adam steps finite where gradients vanish
+		float epsilon = 1e-8f;
+	};
+
+	struct TrainConfig
+	{
+		float maxError = 0.001f;
+		float learningRate = 0.5f;
+
+		// Samples whose gradients are averaged into a single weight update
+		// 1 updates the weights after every sample (online SGD)
+		size_t batchSize = 1;
+
+		// Threads each batch is split across. Used when batchSize > 1 or hogwild
+		size_t numThreads = 1;
+
+		// Lock-free asynchronous SGD: numThreads workers each update the
+		// shared weights after every sample without synchronizing.
+		// Ignores batchSize. Results vary between runs
+		bool hogwild = false;
+		// Called every observeInterval epochs. Empty costs nothing
+		TrainObserver observer;
+		long observeInterval = 1;
+
+		// Visit the samples in a new random order every epoch (uses rand)
+		// Data from a DataSource is shuffled within each chunk
+		bool shuffle = false;
+
+		// Merge samples with duplicate inputs before training. Turn off
+		// when passing data already prepared by NeuralNet::resolveConflicts
+		bool resolveConflicts = true;
+
+		// Samples read from a DataSource at a time, rounded to whole batches
+		size_t chunkSize = 65536;
+
+		// Hogwild always uses plain SGD, with optimizer.biasScale
+		OptimizerConfig optimizer;
+
+		// Limits on the length of training. 0 means no limit
+		long maxEpochs = 0;
+		double maxSeconds = 0;
+
+		// Held out samples scored every validationInterval epochs, with the
+		// same loss as training. When set, training ends with the weights
+		// that scored best. Must outlive the call to backPropagate
+		const Dataset *validation = nullptr;
+		long validationInterval = 1;
+
+		// Stop after this many validations in a row without improvement
+		// 0 keeps going until another stop criterion is met
+		long patience = 0;
 	};
 	
 	class NeuralNet
 	{
 	public:
-		NeuralNet() = default;
+		NeuralNet();
+		NeuralNet(const NeuralNet &other);
+		NeuralNet(NeuralNet &&other);
+		NeuralNet &operator=(const NeuralNet &other);
+		NeuralNet &operator=(NeuralNet &&other);
+		~NeuralNet();
 		NeuralNet(int numInputs, int numHidden, int numHidLayers, int numOutputs);
+
+		// NeuralNet({784, 256, 64, 10}) is ambiguous with the constructor
+		// above; pass a named vector or use fromTopology({784, 256, 64, 10})
+		explicit NeuralNet(const std::vector<size_t> &topology);
+		static NeuralNet fromTopology(const std::vector<size_t> &topology);
 		void create(int numInputs, int numHidden, int numHidLayers, int numOutputs);
+		void create(const std::vector<size_t> &topology);
+		std::vector<size_t> getTopology() const;
 		std::string toString() const;
+		bool save(const std::string &filename, WeightType type = WeightType::F32) const;
+		bool load(const std::string &filename);
+		bool loadMapped(const std::string &filename);
 		size_t getNumInputs() const;
 		size_t getNumOutputs() const;
+		size_t getMaxWidth() const;
 		void randomize();
+		size_t getNumLayers() const;
+		const Layer &getLayer(size_t layerId) const;
+		Layer &getLayer(size_t layerId);
+		void setActivation(size_t layerId, Activation act);
+		Activation getActivation(size_t layerId) const;
+		void setSigmoidMode(SigmoidMode mode);
+
+		// Forgets the optimizer state kept between backPropagate calls
+		void resetOptimizer();
+
+		// Copy of the weights, activations and sigmoid mode only
+		NeuralNet copyWeights() const;
+		SigmoidMode getSigmoidMode() const;
 		BackPropResult backPropagate(const std::vector<FloatVecIO> &vals, float maxError = 0.001f, float learningRate = 0.5f, bool debug = false);
+		BackPropResult backPropagate(const std::vector<FloatVecIO> &vals, const TrainConfig &config);
+		BackPropResult backPropagate(const Dataset &data, const TrainConfig &config);
+		BackPropResult backPropagate(DataSource &source, const TrainConfig &config);
+		static std::vector<FloatVecIO> resolveConflicts(const std::vector<FloatVecIO> &vals);
+		static Dataset resolveConflicts(const Dataset &data);
 		FloatVec2D calcProbFull(const FloatVec &inputVals) const;
 		FloatVec calcProb(const FloatVec &inputVals) const;
+		FloatVec calcProbBatch(const FloatVec &inputRows, size_t numRows) const;
+		FloatVec calcProbBatch(const Dataset &data) const;
+		void calcProb(const float *inputVals, float *outputVals, Workspace &workspace) const;
+		void calcProbBatch(const float *inputRows, size_t numRows, float *outputRows, Workspace &workspace) const;
 
 	private:
-		std::vector<FloatVecIO> resolveConflicts(std::vector<FloatVecIO> vals);
-		float backPropagateStep(const FloatVecIO &vals, float learningRate);
+		/*
+		 * Scratch space for one training thread, sized once so that a
+		 * step allocates nothing: the inputs and every layer's outputs back
+		 * to back, two delta buffers as wide as the widest layer, and the
+		 * gradients when updates are not fused into the backward pass
+		 */
+		struct TrainWorker
+		{
+			TrainWorker(const NeuralNet &net);
+
+			// Start of the inputs of each layer, then of the outputs
+			std::vector<size_t> offsets;
+			AlignedFloatVec nodeVals, deltas, chainSums;
+			std::vector<LayerGradient> grads;
+
+			// Summed error of the samples in the worker's last task
+			float error = 0.f;
+		};
+
+		/*
+		 * What one backPropagate call trains with, set up once so that
+		 * batches and epochs allocate nothing. The pool tasks are built
+		 * once too, and read the samples to work on from here
+		 */
+		struct TrainContext
+		{
+			std::vector<TrainWorker> workers;
+			ThreadPool *pool = nullptr;
+			Optimizer *optimizer = nullptr;
+			std::function<void(size_t)> batchTask, hogwildTask;
+
+			const Dataset *data = nullptr;
+			size_t begin = 0, end = 0;
+			float learningRate = 0.f, biasRate = 0.f;
+
+			// This epoch's samples when shuffling, reused between epochs
+			std::vector<size_t> order;
+			Dataset shuffled;
+		};
+
+		float calcError(const Dataset &data) const;
+		float calcOutputDeltas(const float *outputs, const float *correctVals, float *deltas) const;
+		void forwardStep(const float *inputVals, TrainWorker &worker) const;
+		float backPropagateStep(const float *inputVals, const float *outputVals, float learningRate, float biasRate, TrainWorker &worker);
+		float accumulateGradient(const float *inputVals, const float *outputVals, TrainWorker &worker) const;
+		float hogwildStep(const float *inputVals, const float *outputVals, float learningRate, float biasRate, TrainWorker &worker);
+		float hogwildEpoch(const Dataset &data, TrainContext &context);
+		float backPropagateBatch(const Dataset &data, size_t begin, size_t end, TrainContext &context);
+		Optimizer &prepareOptimizer(const OptimizerConfig &config);
+		void prepareTraining(const TrainConfig &config, TrainContext &context);
+		float trainSamples(const Dataset &samples, const TrainConfig &config, TrainContext &context);
+		BackPropResult trainEpochs(const TrainConfig &config, const std::function<float(size_t &numSamples)> &runEpoch);
 		float calcNode(const Layer &prevRow, const FloatVec &prevVals, int id) const;
 		FloatVec calcLayerOutputs(const Layer &prevRow, const FloatVec &prevVals) const;
+		void calcLayerOutputsBatch(const Layer &row, const float *prevVals, size_t numRows, float *outVals) const;
 
 		std::vector<Layer> layers;
+		SigmoidMode sigmoidMode = SigmoidMode::Exact;
+		std::unique_ptr<Optimizer> optimizer;
 	};
 }
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "sciod/NeuralNet.hpp"
+
+namespace sciod
+{
+	/*
+	 * How closely a QuantizedNet follows the float net it came from
+	 */
+	struct QuantizationReport
+	{
+		// Differences between quantized and float outputs
+		float maxAbsError = 0.f;
+		float meanAbsError = 0.f;
+
+		// Fraction of rows whose predicted class matches the expected
+		// outputs: the largest output, or above 0.5 for a single output
+		float floatAccuracy = 0.f;
+		float quantizedAccuracy = 0.f;
+	};
+
+	/*
+	 * Inference only copy of a trained NeuralNet with 8 bit weights
+	 *
+	 * Each weight row has its own scale, so a row of small weights keeps
+	 * its precision next to one of large weights. Layer inputs become
+	 * unsigned 8 bit values using a range measured on calibration data.
+	 * Dot products accumulate exactly in 32 bits; biases and activations
+	 * stay in float
+	 */
+	class QuantizedNet
+	{
+	public:
+		QuantizedNet() = default;
+		bool quantize(const NeuralNet &net, const Dataset &calibration);
+		size_t getNumInputs() const;
+		size_t getNumOutputs() const;
+		size_t getNumLayers() const;
+		FloatVec calcProb(const FloatVec &inputVals) const;
+		void calcProbBatch(const float *inputRows, size_t numRows, float *outputRows) const;
+		QuantizationReport compare(const NeuralNet &net, const Dataset &data) const;
+
+	private:
+		using ByteVec = std::vector<uint8_t, AlignedAllocator<uint8_t>>;
+		using WeightVec = std::vector<int8_t, AlignedAllocator<int8_t>>;
+
+		struct QuantizedLayer
+		{
+			size_t prevSize, size;
+
+			// Bytes per weight row, padded with zero weights to a cache line
+			size_t stride;
+			Activation activation;
+
+			// input ~= inScale * (quantized input - inZero)
+			float inScale;
+			int32_t inZero;
+
+			// weight ~= weightScales[dest] * quantized weight
+			WeightVec weights;
+			FloatVec weightScales;
+
+			// Sum of each quantized weight row, to remove inZero from the dot product
+			std::vector<int32_t> rowSums;
+			FloatVec biases;
+		};
+
+		void quantizeInputs(const QuantizedLayer &layer, const float *vals, size_t numRows, uint8_t *out) const;
+
+		std::vector<QuantizedLayer> layers;
+		SigmoidMode sigmoidMode = SigmoidMode::Exact;
+	};
+}
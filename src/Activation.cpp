@@ -0,0 +1,101 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include "sciod/Activation.hpp"
+#include "Kernels.hpp"
+
+using namespace std;
+
+namespace sciod
+{
+
+float squash(float val)
+{
+	return 1.f / (1 + exp(-val));
+}
+
+void squash(float *vals, size_t n, SigmoidMode mode)
+{
+	if (mode == SigmoidMode::Fast)
+		sigmoidFast(vals, n);
+	else
+		sigmoidExact(vals, n);
+}
+
+static void softmaxRow(float *vals, size_t width)
+{
+	float maxVal = *max_element(vals, vals + width);
+	float sum = 0.f;
+	for (size_t i = 0; i < width; ++i)
+	{
+		vals[i] = exp(vals[i] - maxVal);
+		sum += vals[i];
+	}
+	float scale = 1.f / sum;
+	for (size_t i = 0; i < width; ++i)
+		vals[i] *= scale;
+}
+
+void activate(Activation act, float *vals, size_t numRows, size_t width, SigmoidMode mode)
+{
+	const size_t n = numRows * width;
+	switch (act)
+	{
+		case Activation::Sigmoid:
+			squash(vals, n, mode);
+			break;
+		case Activation::Tanh:
+			// tanh(x) = 2 * sigmoid(2x) - 1
+			for (size_t i = 0; i < n; ++i)
+				vals[i] *= 2.f;
+			squash(vals, n, mode);
+			for (size_t i = 0; i < n; ++i)
+				vals[i] = 2.f * vals[i] - 1.f;
+			break;
+		case Activation::Relu:
+			for (size_t i = 0; i < n; ++i)
+				vals[i] = vals[i] > 0.f ? vals[i] : 0.f;
+			break;
+		case Activation::LeakyRelu:
+			for (size_t i = 0; i < n; ++i)
+				vals[i] = vals[i] > 0.f ? vals[i] : leakyReluSlope * vals[i];
+			break;
+		case Activation::Linear:
+			break;
+		case Activation::Softmax:
+			for (size_t row = 0; row < numRows; ++row)
+				softmaxRow(vals + row * width, width);
+			break;
+	}
+}
+
+void activationDeriv(Activation act, const float *outputs, float *deltas, size_t n)
+{
+	switch (act)
+	{
+		case Activation::Sigmoid:
+			for (size_t i = 0; i < n; ++i)
+				deltas[i] *= outputs[i] * (1 - outputs[i]);
+			break;
+		case Activation::Tanh:
+			for (size_t i = 0; i < n; ++i)
+				deltas[i] *= 1 - outputs[i] * outputs[i];
+			break;
+		case Activation::Relu:
+			for (size_t i = 0; i < n; ++i)
+				deltas[i] = outputs[i] > 0.f ? deltas[i] : 0.f;
+			break;
+		case Activation::LeakyRelu:
+			for (size_t i = 0; i < n; ++i)
+				deltas[i] *= outputs[i] > 0.f ? 1.f : leakyReluSlope;
+			break;
+		case Activation::Linear:
+			break;
+		case Activation::Softmax:
+			// Only valid as the output layer, whose deltas come from the loss
+			assert(false);
+			break;
+	}
+}
+
+}
@@ -0,0 +1,100 @@
+#include <cstdlib>
+#include <cctype>
+#include <stdexcept>
+#include "sciod/DataSource.hpp"
+
+using namespace std;
+
+namespace sciod
+{
+
+CsvReader::CsvReader(const ColumnSpec &columns, char delimiter, bool hasHeader) :
+		columns(columns), delimiter(delimiter), hasHeader(hasHeader)
+{
+}
+
+/*
+ * Opens filename and positions the reader at the first sample
+ * Returns false if the file could not be opened
+ */
+bool CsvReader::open(const string &filename)
+{
+	this->filename = filename;
+	file.close();
+	file.open(filename);
+	if (!file)
+		return false;
+	rewind();
+	return true;
+}
+
+size_t CsvReader::read(Dataset &rows, size_t maxRows)
+{
+	// Rows are reused between chunks so steady state reading allocates nothing
+	if (rows.getNumInputs() != columns.inputs.size() || rows.getNumOutputs() != columns.outputs.size())
+		rows = Dataset(columns.inputs.size(), columns.outputs.size());
+	rows.clear();
+	rows.reserve(maxRows);
+	while (rows.size() < maxRows && getline(file, line))
+	{
+		++lineNum;
+		if (line.find_first_not_of(" \t\r") == string::npos)
+			continue;
+		size_t row = rows.size();
+		rows.resize(row + 1);
+		parseLine(rows.getInputs(row), rows.getOutputs(row));
+	}
+	return rows.size();
+}
+
+void CsvReader::rewind()
+{
+	file.clear();
+	file.seekg(0);
+	lineNum = 0;
+	if (hasHeader && getline(file, line))
+		++lineNum;
+}
+
+static float parseField(const char *field, size_t col, size_t lineNum)
+{
+	char *end;
+	float val = strtof(field, &end);
+	while (isspace(static_cast<unsigned char>(*end)))
+		++end;
+	if (end == field || *end != '\0')
+		throw runtime_error("line " + to_string(lineNum) + ": column " + to_string(col) + " is not a number");
+	return val;
+}
+
+/*
+ * Splits line in place at each delimiter and converts the selected columns
+ */
+void CsvReader::parseLine(float *inputVals, float *outputVals)
+{
+	fields.clear();
+	fields.push_back(&line[0]);
+	for (char &c : line)
+	{
+		if (c == delimiter)
+		{
+			c = '\0';
+			fields.push_back(&c + 1);
+		}
+	}
+
+	auto convert = [&](const vector<size_t> &cols, float *out)
+	{
+		for (size_t i = 0; i < cols.size(); ++i)
+		{
+			if (cols[i] >= fields.size())
+				throw runtime_error("line " + to_string(lineNum) + ": expected at least " +
+									to_string(cols[i] + 1) + " columns, found " + to_string(fields.size()));
+			out[i] = parseField(fields[cols[i]], cols[i], lineNum);
+		}
+	};
+	convert(columns.inputs, inputVals);
+	convert(columns.outputs, outputVals);
+}
+
+}
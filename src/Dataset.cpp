@@ -0,0 +1,123 @@
+#include <cassert>
+#include <cstdlib>
+#include <algorithm>
+#include "sciod/Dataset.hpp"
+
+using namespace std;
+
+namespace sciod
+{
+
+Dataset::Dataset(size_t numInputs, size_t numOutputs) : numInputs(numInputs), numOutputs(numOutputs) { }
+
+Dataset::Dataset(const vector<FloatVecIO> &vals) :
+numInputs(vals.empty() ? 0 : vals[0].in.size()), numOutputs(vals.empty() ? 0 : vals[0].out.size())
+{
+	reserve(vals.size());
+	for (auto &i : vals)
+		addRow(i.in, i.out);
+}
+
+size_t Dataset::size() const
+{
+	return numRows;
+}
+
+bool Dataset::empty() const
+{
+	return numRows == 0;
+}
+
+size_t Dataset::getNumInputs() const
+{
+	return numInputs;
+}
+
+size_t Dataset::getNumOutputs() const
+{
+	return numOutputs;
+}
+
+void Dataset::reserve(size_t numRows)
+{
+	inputs.reserve(numRows * numInputs);
+	outputs.reserve(numRows * numOutputs);
+}
+
+/*
+ * New rows are zeroed, ready to be filled through the row pointers
+ */
+void Dataset::resize(size_t numRows)
+{
+	this->numRows = numRows;
+	inputs.resize(numRows * numInputs, 0.f);
+	outputs.resize(numRows * numOutputs, 0.f);
+}
+
+/*
+ * Removes every row but keeps the memory for reuse
+ */
+void Dataset::clear()
+{
+	resize(0);
+}
+
+void Dataset::addRow(const float *inputVals, const float *outputVals)
+{
+	inputs.insert(inputs.end(), inputVals, inputVals + numInputs);
+	outputs.insert(outputs.end(), outputVals, outputVals + numOutputs);
+	++numRows;
+}
+
+void Dataset::addRow(const FloatVec &inputVals, const FloatVec &outputVals)
+{
+	assert(inputVals.size() == numInputs && outputVals.size() == numOutputs);
+	addRow(inputVals.data(), outputVals.data());
+}
+
+float *Dataset::getInputs(size_t row)
+{
+	assert(row < numRows);
+	return inputs.data() + row * numInputs;
+}
+
+const float *Dataset::getInputs(size_t row) const
+{
+	assert(row < numRows);
+	return inputs.data() + row * numInputs;
+}
+
+float *Dataset::getOutputs(size_t row)
+{
+	assert(row < numRows);
+	return outputs.data() + row * numOutputs;
+}
+
+const float *Dataset::getOutputs(size_t row) const
+{
+	assert(row < numRows);
+	return outputs.data() + row * numOutputs;
+}
+
+const float *Dataset::getInputs() const
+{
+	return inputs.data();
+}
+
+const float *Dataset::getOutputs() const
+{
+	return outputs.data();
+}
+
+void Dataset::shuffledIndices(vector<size_t> &indices) const
+{
+	indices.resize(numRows);
+	for (size_t i = 0; i < numRows; ++i)
+		indices[i] = i;
+
+	// Fisher-Yates
+	for (size_t i = numRows; i > 1; --i)
+		swap(indices[i - 1], indices[rand() % i]);
+}
+
+}
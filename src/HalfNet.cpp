@@ -0,0 +1,98 @@
+#include <cassert>
+#include <algorithm>
+#include "sciod/HalfNet.hpp"
+#include "Kernels.hpp"
+
+using namespace std;
+
+namespace sciod
+{
+
+HalfNet::HalfNet(const NeuralNet &net, WeightType type)
+{
+	convert(net, type);
+}
+
+/*
+ * Replaces the contents with net's weights rounded to type
+ */
+void HalfNet::convert(const NeuralNet &net, WeightType type)
+{
+	assert(type != WeightType::F32);
+	vector<HalfLayer> newLayers(net.getNumLayers());
+	for (size_t layerId = 0; layerId < newLayers.size(); ++layerId)
+	{
+		const Layer &row = net.getLayer(layerId);
+		HalfLayer &layer = newLayers[layerId];
+		layer.prevSize = row.numPrevNodes();
+		layer.size = row.numNodes();
+		layer.activation = row.getActivation();
+		layer.weights.resize(layer.prevSize * layer.size);
+		for (size_t i = 0; i < layer.weights.size(); ++i)
+			layer.weights[i] = floatToHalf(row.getWeights()[i], type);
+		layer.biases.assign(row.getBiases(), row.getBiases() + layer.size);
+	}
+	layers = move(newLayers);
+	weightType = type;
+	sigmoidMode = net.getSigmoidMode();
+}
+
+WeightType HalfNet::getWeightType() const
+{
+	return weightType;
+}
+
+size_t HalfNet::getNumInputs() const
+{
+	return layers.empty() ? 0 : layers[0].prevSize;
+}
+
+size_t HalfNet::getNumOutputs() const
+{
+	return layers.empty() ? 0 : layers.back().size;
+}
+
+size_t HalfNet::getNumLayers() const
+{
+	return layers.size();
+}
+
+FloatVec HalfNet::calcProb(const FloatVec &inputVals) const
+{
+	assert(inputVals.size() == getNumInputs());
+	FloatVec outputVals(getNumOutputs());
+	calcProbBatch(inputVals.data(), 1, outputVals.data());
+	return outputVals;
+}
+
+/*
+ * Same layout as NeuralNet::calcProbBatch: rows stored back to back
+ */
+void HalfNet::calcProbBatch(const float *inputRows, size_t numRows, float *outputRows) const
+{
+	size_t maxWidth = 0;
+	for (auto &layer : layers)
+		maxWidth = max(maxWidth, layer.size);
+
+	const size_t rowTile = min<size_t>(numRows, 256);
+	AlignedFloatVec bufA(rowTile * maxWidth), bufB(rowTile * maxWidth);
+	for (size_t start = 0; start < numRows; start += rowTile)
+	{
+		size_t tileRows = min(rowTile, numRows - start);
+		const float *prev = inputRows + start * getNumInputs();
+		float *next = bufA.data();
+		for (size_t layerId = 0; layerId < layers.size(); ++layerId)
+		{
+			const HalfLayer &layer = layers[layerId];
+			if (layerId + 1 == layers.size())
+				next = outputRows + start * getNumOutputs();
+			denseForwardHalf(prev, tileRows, layer.prevSize, layer.weights.data(), weightType,
+							layer.biases.data(), layer.size, next);
+			activate(layer.activation, next, tileRows, layer.size, sigmoidMode);
+			prev = next;
+			next = next == bufA.data() ? bufB.data() : bufA.data();
+		}
+	}
+}
+
+}
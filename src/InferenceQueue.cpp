@@ -0,0 +1,124 @@
+#include <cassert>
+#include <algorithm>
+#include "sciod/InferenceQueue.hpp"
+
+using namespace std;
+
+namespace sciod
+{
+
+InferenceQueue::InferenceQueue(ModelPtr model, const QueueConfig &config) :
+config(config), getModel([model] { return model; }), numInputs(model->getNumInputs())
+{
+	this->config.maxBatchSize = max<size_t>(1, config.maxBatchSize);
+	worker = thread(&InferenceQueue::workerLoop, this);
+}
+
+InferenceQueue::InferenceQueue(const Trainer &trainer, const QueueConfig &config) :
+config(config), getModel([&trainer] { return trainer.getModel(); }), numInputs(trainer.getModel()->getNumInputs())
+{
+	this->config.maxBatchSize = max<size_t>(1, config.maxBatchSize);
+	worker = thread(&InferenceQueue::workerLoop, this);
+}
+
+InferenceQueue::~InferenceQueue()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeCond.notify_one();
+	worker.join();
+}
+
+future<FloatVec> InferenceQueue::submit(const FloatVec &inputVals)
+{
+	assert(inputVals.size() == numInputs);
+	return submit(inputVals.data());
+}
+
+future<FloatVec> InferenceQueue::submit(const float *inputVals)
+{
+	Request request;
+	request.inputVals.assign(inputVals, inputVals + numInputs);
+	request.arrival = Clock::now();
+	future<FloatVec> result = request.result.get_future();
+	{
+		lock_guard<std::mutex> lock(mutex);
+		pending.push_back(move(request));
+	}
+	wakeCond.notify_one();
+	return result;
+}
+
+size_t InferenceQueue::getNumInputs() const
+{
+	return numInputs;
+}
+
+size_t InferenceQueue::getNumBatches() const
+{
+	lock_guard<std::mutex> lock(mutex);
+	return numBatches;
+}
+
+void InferenceQueue::workerLoop()
+{
+	const chrono::microseconds maxWait(config.maxWaitMicros);
+	vector<Request> batch;
+	unique_lock<std::mutex> lock(mutex);
+	while (1)
+	{
+		wakeCond.wait(lock, [this] { return stopping || !pending.empty(); });
+		if (pending.empty())
+			return;
+
+		// Give later requests until the oldest one's deadline to join it
+		Clock::time_point deadline = pending.front().arrival + maxWait;
+		wakeCond.wait_until(lock, deadline, [this]
+		{
+			return stopping || pending.size() >= config.maxBatchSize;
+		});
+
+		size_t batchSize = min(pending.size(), config.maxBatchSize);
+		for (size_t i = 0; i < batchSize; ++i)
+		{
+			batch.push_back(move(pending.front()));
+			pending.pop_front();
+		}
+		++numBatches;
+
+		lock.unlock();
+		runBatch(batch);
+		batch.clear();
+		lock.lock();
+	}
+}
+
+void InferenceQueue::runBatch(vector<Request> &batch)
+{
+	// A workspace fits any net no wider than the one it was made for, so
+	// newly published weights of the same topology reuse it
+	ModelPtr model = getModel();
+	const size_t maxWidth = model->getNet().getMaxWidth();
+	if (maxWidth > workspaceWidth)
+	{
+		workspace = Workspace(model->getNet(), config.maxBatchSize);
+		workspaceWidth = maxWidth;
+	}
+
+	const size_t numOutputs = model->getNumOutputs();
+	inputRows.resize(batch.size() * numInputs);
+	outputRows.resize(batch.size() * numOutputs);
+	for (size_t r = 0; r < batch.size(); ++r)
+		copy(batch[r].inputVals.begin(), batch[r].inputVals.end(), inputRows.begin() + r * numInputs);
+
+	model->calcProbBatch(inputRows.data(), batch.size(), outputRows.data(), workspace);
+	for (size_t r = 0; r < batch.size(); ++r)
+	{
+		auto rowBegin = outputRows.begin() + r * numOutputs;
+		batch[r].result.set_value(FloatVec(rowBegin, rowBegin + numOutputs));
+	}
+}
+
+}
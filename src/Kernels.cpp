@@ -0,0 +1,1115 @@
+#include <cassert>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "Kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCIOD_X86
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+using namespace std;
+
+namespace sciod
+{
+
+namespace
+{
+	/*
+	 * Implementations of every kernel for a single instruction set
+	 * block4x4 computes four input rows against four weight rows
+	 */
+	struct KernelTable
+	{
+		Isa isa;
+		float (*dot)(const float *a, const float *b, size_t n);
+		void (*axpy)(float alpha, const float *x, float *y, size_t n);
+		void (*dualAxpy)(float alpha, const float *x1, float *y1, float beta, const float *x2, float *y2, size_t n);
+		void (*block4x4)(const float *in, size_t inSize, const float *weights, float *out, size_t outStride);
+		void (*sigmoidFast)(float *vals, size_t n);
+		int32_t (*dotU8S8)(const uint8_t *a, const int8_t *b, size_t n);
+		void (*block4x4U8S8)(const uint8_t *in, size_t stride, const int8_t *weights, int32_t *out, size_t outStride);
+		void (*f16ToF32)(const uint16_t *in, float *out, size_t n);
+		void (*bf16ToF32)(const uint16_t *in, float *out, size_t n);
+		float (*dotF16)(const float *a, const uint16_t *b, size_t n);
+		float (*dotBf16)(const float *a, const uint16_t *b, size_t n);
+	};
+}
+
+/*
+ * Fast sigmoid: 1 / (1 + 2^t) with t = -x * log2(e)
+ * 2^t is split into 2^floor(t), built directly in the exponent bits,
+ * times a degree 4 minimax polynomial for 2^f over f in [0, 1)
+ * Max absolute error of the sigmoid is below 5e-6
+ */
+static const float log2e = 1.44269504f;
+static const float expClamp = 126.f;
+static const float expPoly[5] = {1.f, 0.69304699f, 0.24150988f, 0.05171806f, 0.01368863f};
+
+// ====== Scalar ======
+
+static float dotScalar(const float *a, const float *b, size_t n)
+{
+	float sum = 0.f;
+	for (size_t i = 0; i < n; ++i)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+static void axpyScalar(float alpha, const float *x, float *y, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		y[i] += alpha * x[i];
+}
+
+/*
+ * x1 may be the same buffer as y2: each element is read before it is written
+ */
+static void dualAxpyScalar(float alpha, const float *x1, float *y1, float beta, const float *x2, float *y2, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		float val = x1[i];
+		y1[i] += alpha * val;
+		y2[i] += beta * x2[i];
+	}
+}
+
+/*
+ * Every loaded value is reused four times from registers
+ */
+static void block4x4Scalar(const float *in, size_t inSize, const float *weights,
+						float *out, size_t outStride)
+{
+	float acc[4][4] = {};
+	const float *in0 = in, *in1 = in + inSize, *in2 = in + 2 * inSize, *in3 = in + 3 * inSize;
+	const float *w0 = weights, *w1 = weights + inSize, *w2 = weights + 2 * inSize, *w3 = weights + 3 * inSize;
+	for (size_t src = 0; src < inSize; ++src)
+	{
+		const float a[4] = {in0[src], in1[src], in2[src], in3[src]};
+		const float b[4] = {w0[src], w1[src], w2[src], w3[src]};
+		for (int r = 0; r < 4; ++r)
+			for (int d = 0; d < 4; ++d)
+				acc[r][d] += a[r] * b[d];
+	}
+	for (int r = 0; r < 4; ++r)
+		for (int d = 0; d < 4; ++d)
+			out[r * outStride + d] = acc[r][d];
+}
+
+static void sigmoidFastScalar(float *vals, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		float t = min(max(-vals[i] * log2e, -expClamp), expClamp);
+		float whole = floor(t);
+		float f = t - whole;
+		float poly = expPoly[4];
+		for (int k = 3; k >= 0; --k)
+			poly = poly * f + expPoly[k];
+		int32_t bits = (int32_t(whole) + 127) << 23;
+		float scale;
+		memcpy(&scale, &bits, sizeof(scale));
+		vals[i] = 1.f / (1.f + poly * scale);
+	}
+}
+
+static int32_t dotU8S8Scalar(const uint8_t *a, const int8_t *b, size_t n)
+{
+	int32_t sum = 0;
+	for (size_t i = 0; i < n; ++i)
+		sum += int32_t(a[i]) * b[i];
+	return sum;
+}
+
+static float f16ToF32One(uint16_t half)
+{
+	uint32_t sign = uint32_t(half & 0x8000) << 16;
+	uint32_t exp = (half >> 10) & 0x1f, mant = half & 0x3ff;
+	uint32_t bits;
+	if (exp == 0x1f)
+		bits = sign | 0x7f800000 | (mant << 13);
+	else if (exp != 0)
+		bits = sign | ((exp + 112) << 23) | (mant << 13);
+	else if (mant == 0)
+		bits = sign;
+	else
+	{
+		// Subnormal: shift the mantissa up until it has a leading one
+		exp = 113;
+		while (!(mant & 0x400))
+		{
+			mant <<= 1;
+			--exp;
+		}
+		bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+	}
+	float val;
+	memcpy(&val, &bits, sizeof(val));
+	return val;
+}
+
+static void f16ToF32Scalar(const uint16_t *in, float *out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = f16ToF32One(in[i]);
+}
+
+static void bf16ToF32Scalar(const uint16_t *in, float *out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		uint32_t bits = uint32_t(in[i]) << 16;
+		memcpy(out + i, &bits, sizeof(float));
+	}
+}
+
+static float dotF16Scalar(const float *a, const uint16_t *b, size_t n)
+{
+	float sum = 0.f;
+	for (size_t i = 0; i < n; ++i)
+		sum += a[i] * f16ToF32One(b[i]);
+	return sum;
+}
+
+static float dotBf16Scalar(const float *a, const uint16_t *b, size_t n)
+{
+	float sum = 0.f;
+	for (size_t i = 0; i < n; ++i)
+	{
+		uint32_t bits = uint32_t(b[i]) << 16;
+		float val;
+		memcpy(&val, &bits, sizeof(val));
+		sum += a[i] * val;
+	}
+	return sum;
+}
+
+/*
+ * Without enough registers to keep a 4x4 block of integer accumulators,
+ * the block is sixteen separate dot products
+ */
+template <int32_t (*Dot)(const uint8_t *, const int8_t *, size_t)>
+static void block4x4U8S8FromDot(const uint8_t *in, size_t stride, const int8_t *weights,
+								int32_t *out, size_t outStride)
+{
+	for (int r = 0; r < 4; ++r)
+		for (int d = 0; d < 4; ++d)
+			out[r * outStride + d] = Dot(in + r * stride, weights + d * stride, stride);
+}
+
+#ifdef SCIOD_X86
+
+// ====== SSE ======
+
+__attribute__((target("sse2")))
+static inline float hsum128(__m128 v)
+{
+	__m128 shuf = _mm_movehl_ps(v, v);
+	v = _mm_add_ps(v, shuf);
+	shuf = _mm_shuffle_ps(v, v, 0x55);
+	v = _mm_add_ss(v, shuf);
+	return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse2")))
+static float dotSse(const float *a, const float *b, size_t n)
+{
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	for (; i + 4 <= n; i += 4)
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	float sum = hsum128(_mm_add_ps(s0, s1));
+	for (; i < n; ++i)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+__attribute__((target("sse2")))
+static void axpySse(float alpha, const float *x, float *y, size_t n)
+{
+	const __m128 a = _mm_set1_ps(alpha);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(a, _mm_loadu_ps(x + i))));
+	for (; i < n; ++i)
+		y[i] += alpha * x[i];
+}
+
+__attribute__((target("sse2")))
+static void dualAxpySse(float alpha, const float *x1, float *y1, float beta, const float *x2, float *y2, size_t n)
+{
+	const __m128 a = _mm_set1_ps(alpha), b = _mm_set1_ps(beta);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 val = _mm_loadu_ps(x1 + i);
+		__m128 upd = _mm_add_ps(_mm_loadu_ps(y2 + i), _mm_mul_ps(b, _mm_loadu_ps(x2 + i)));
+		_mm_storeu_ps(y1 + i, _mm_add_ps(_mm_loadu_ps(y1 + i), _mm_mul_ps(a, val)));
+		_mm_storeu_ps(y2 + i, upd);
+	}
+	dualAxpyScalar(alpha, x1 + i, y1 + i, beta, x2 + i, y2 + i, n - i);
+}
+
+/*
+ * Done as two halves of two rows each to stay within the register file
+ */
+__attribute__((target("sse2")))
+static void block4x4Sse(const float *in, size_t inSize, const float *weights,
+						float *out, size_t outStride)
+{
+	for (int half = 0; half < 2; ++half)
+	{
+		const float *a0 = in + 2 * half * inSize, *a1 = a0 + inSize;
+		__m128 acc[2][4];
+		for (int d = 0; d < 4; ++d)
+			acc[0][d] = acc[1][d] = _mm_setzero_ps();
+
+		size_t src = 0;
+		for (; src + 4 <= inSize; src += 4)
+		{
+			__m128 x0 = _mm_loadu_ps(a0 + src), x1 = _mm_loadu_ps(a1 + src);
+			for (int d = 0; d < 4; ++d)
+			{
+				__m128 w = _mm_loadu_ps(weights + d * inSize + src);
+				acc[0][d] = _mm_add_ps(acc[0][d], _mm_mul_ps(x0, w));
+				acc[1][d] = _mm_add_ps(acc[1][d], _mm_mul_ps(x1, w));
+			}
+		}
+		for (int r = 0; r < 2; ++r)
+			for (int d = 0; d < 4; ++d)
+			{
+				const float *a = r == 0 ? a0 : a1, *w = weights + d * inSize;
+				float sum = hsum128(acc[r][d]);
+				for (size_t i = src; i < inSize; ++i)
+					sum += a[i] * w[i];
+				out[(2 * half + r) * outStride + d] = sum;
+			}
+	}
+}
+
+__attribute__((target("sse2")))
+static void sigmoidFastSse(float *vals, size_t n)
+{
+	const __m128 one = _mm_set1_ps(1.f);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 t = _mm_mul_ps(_mm_loadu_ps(vals + i), _mm_set1_ps(-log2e));
+		t = _mm_min_ps(_mm_max_ps(t, _mm_set1_ps(-expClamp)), _mm_set1_ps(expClamp));
+		// SSE2 has no floor: truncate, then step down where that rounded up
+		__m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+		whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, t), one));
+		__m128 f = _mm_sub_ps(t, whole);
+		__m128 poly = _mm_set1_ps(expPoly[4]);
+		for (int k = 3; k >= 0; --k)
+			poly = _mm_add_ps(_mm_mul_ps(poly, f), _mm_set1_ps(expPoly[k]));
+		__m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(whole), _mm_set1_epi32(127)), 23);
+		__m128 e = _mm_mul_ps(poly, _mm_castsi128_ps(bits));
+		_mm_storeu_ps(vals + i, _mm_div_ps(one, _mm_add_ps(one, e)));
+	}
+	sigmoidFastScalar(vals + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static inline int32_t hsum128i(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+	return _mm_cvtsi128_si32(v);
+}
+
+/*
+ * Bytes are widened to 16 bits so pmaddwd sums pairs straight into
+ * 32 bits; pmaddubsw would saturate on large activations and weights
+ */
+__attribute__((target("sse2")))
+static int32_t dotU8S8Sse(const uint8_t *a, const int8_t *b, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+		__m128i sign = _mm_cmpgt_epi8(zero, vb);
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, sign)));
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, sign)));
+	}
+	return hsum128i(acc) + dotU8S8Scalar(a + i, b + i, n - i);
+}
+
+// bfloat16 is the top half of a float, so interleaving zeros below it widens it
+__attribute__((target("sse2")))
+static void bf16ToF32Sse(const uint16_t *in, float *out, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		_mm_storeu_ps(out + i, _mm_castsi128_ps(_mm_unpacklo_epi16(zero, half)));
+		_mm_storeu_ps(out + i + 4, _mm_castsi128_ps(_mm_unpackhi_epi16(zero, half)));
+	}
+	bf16ToF32Scalar(in + i, out + i, n - i);
+}
+
+// ====== AVX2 + FMA ======
+
+__attribute__((target("avx2,fma")))
+static inline float hsum256(__m256 v)
+{
+	return hsum128(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+static float dotAvx2(const float *a, const float *b, size_t n)
+{
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	__m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32)
+	{
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+		s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+		s2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), s2);
+		s3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), s3);
+	}
+	for (; i + 8 <= n; i += 8)
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+	float sum = hsum256(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+	for (; i < n; ++i)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static void axpyAvx2(float alpha, const float *x, float *y, size_t n)
+{
+	const __m256 a = _mm256_set1_ps(alpha);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		_mm256_storeu_ps(y + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+		_mm256_storeu_ps(y + i + 8, _mm256_fmadd_ps(a, _mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8)));
+	}
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(y + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+	for (; i < n; ++i)
+		y[i] += alpha * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void dualAxpyAvx2(float alpha, const float *x1, float *y1, float beta, const float *x2, float *y2, size_t n)
+{
+	const __m256 a = _mm256_set1_ps(alpha), b = _mm256_set1_ps(beta);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 val = _mm256_loadu_ps(x1 + i);
+		__m256 upd = _mm256_fmadd_ps(b, _mm256_loadu_ps(x2 + i), _mm256_loadu_ps(y2 + i));
+		_mm256_storeu_ps(y1 + i, _mm256_fmadd_ps(a, val, _mm256_loadu_ps(y1 + i)));
+		_mm256_storeu_ps(y2 + i, upd);
+	}
+	dualAxpyScalar(alpha, x1 + i, y1 + i, beta, x2 + i, y2 + i, n - i);
+}
+
+/*
+ * Done as two halves of two rows each: 8 accumulators plus operands
+ * fit in the 16 ymm registers without spilling
+ */
+__attribute__((target("avx2,fma")))
+static void block4x4Avx2(const float *in, size_t inSize, const float *weights,
+						float *out, size_t outStride)
+{
+	for (int half = 0; half < 2; ++half)
+	{
+		const float *a0 = in + 2 * half * inSize, *a1 = a0 + inSize;
+		__m256 acc[2][4];
+		for (int d = 0; d < 4; ++d)
+			acc[0][d] = acc[1][d] = _mm256_setzero_ps();
+
+		size_t src = 0;
+		for (; src + 8 <= inSize; src += 8)
+		{
+			__m256 x0 = _mm256_loadu_ps(a0 + src), x1 = _mm256_loadu_ps(a1 + src);
+			for (int d = 0; d < 4; ++d)
+			{
+				__m256 w = _mm256_loadu_ps(weights + d * inSize + src);
+				acc[0][d] = _mm256_fmadd_ps(x0, w, acc[0][d]);
+				acc[1][d] = _mm256_fmadd_ps(x1, w, acc[1][d]);
+			}
+		}
+		for (int r = 0; r < 2; ++r)
+			for (int d = 0; d < 4; ++d)
+			{
+				const float *a = r == 0 ? a0 : a1, *w = weights + d * inSize;
+				float sum = hsum256(acc[r][d]);
+				for (size_t i = src; i < inSize; ++i)
+					sum += a[i] * w[i];
+				out[(2 * half + r) * outStride + d] = sum;
+			}
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void sigmoidFastAvx2(float *vals, size_t n)
+{
+	const __m256 one = _mm256_set1_ps(1.f);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 t = _mm256_mul_ps(_mm256_loadu_ps(vals + i), _mm256_set1_ps(-log2e));
+		t = _mm256_min_ps(_mm256_max_ps(t, _mm256_set1_ps(-expClamp)), _mm256_set1_ps(expClamp));
+		__m256 whole = _mm256_floor_ps(t);
+		__m256 f = _mm256_sub_ps(t, whole);
+		__m256 poly = _mm256_set1_ps(expPoly[4]);
+		for (int k = 3; k >= 0; --k)
+			poly = _mm256_fmadd_ps(poly, f, _mm256_set1_ps(expPoly[k]));
+		__m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(whole), _mm256_set1_epi32(127)), 23);
+		__m256 e = _mm256_mul_ps(poly, _mm256_castsi256_ps(bits));
+		_mm256_storeu_ps(vals + i, _mm256_div_ps(one, _mm256_add_ps(one, e)));
+	}
+	sigmoidFastScalar(vals + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static int32_t dotU8S8Avx2(const uint8_t *a, const int8_t *b, size_t n)
+{
+	__m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32)
+	{
+		__m256i a0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+		__m256i b0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+		__m256i a1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 16)));
+		__m256i b1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 16)));
+		s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(a0, b0));
+		s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(a1, b1));
+	}
+	__m256i sum = _mm256_add_epi32(s0, s1);
+	return hsum128i(_mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1))) +
+		dotU8S8Scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static inline int32_t hsum256i(__m256i v)
+{
+	return hsum128i(_mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+/*
+ * Two input rows against four weight rows, 16 bytes at a time
+ * Eight accumulators plus operands fit in the 16 ymm registers
+ */
+__attribute__((target("avx2,fma")))
+static inline void block2x4U8S8Avx2(const uint8_t *in, size_t stride, const int8_t *weights,
+									int32_t *out, size_t outStride)
+{
+	__m256i acc[2][4];
+	for (int r = 0; r < 2; ++r)
+		for (int d = 0; d < 4; ++d)
+			acc[r][d] = _mm256_setzero_si256();
+	for (size_t i = 0; i < stride; i += 16)
+	{
+		__m256i a0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)));
+		__m256i a1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + stride + i)));
+		for (int d = 0; d < 4; ++d)
+		{
+			__m256i w = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(weights + d * stride + i)));
+			acc[0][d] = _mm256_add_epi32(acc[0][d], _mm256_madd_epi16(a0, w));
+			acc[1][d] = _mm256_add_epi32(acc[1][d], _mm256_madd_epi16(a1, w));
+		}
+	}
+	for (int r = 0; r < 2; ++r)
+		for (int d = 0; d < 4; ++d)
+			out[r * outStride + d] = hsum256i(acc[r][d]);
+}
+
+__attribute__((target("avx2,fma")))
+static void block4x4U8S8Avx2(const uint8_t *in, size_t stride, const int8_t *weights,
+							int32_t *out, size_t outStride)
+{
+	block2x4U8S8Avx2(in, stride, weights, out, outStride);
+	block2x4U8S8Avx2(in + 2 * stride, stride, weights, out + 2 * outStride, outStride);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static void f16ToF32Avx2(const uint16_t *in, float *out, size_t n)
+{
+	// The scalar tail runs first, before the upper registers are dirty
+	const size_t vecEnd = n / 8 * 8;
+	f16ToF32Scalar(in + vecEnd, out + vecEnd, n - vecEnd);
+	for (size_t i = 0; i < vecEnd; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i))));
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float dotF16Avx2(const float *a, const uint16_t *b, size_t n)
+{
+	// The scalar tail runs first, before the upper registers are dirty
+	const size_t vecEnd = n / 16 * 16;
+	float tail = dotF16Scalar(a + vecEnd, b + vecEnd, n - vecEnd);
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	for (size_t i = 0; i < vecEnd; i += 16)
+	{
+		__m256 b0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+		__m256 b1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 8)));
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), b0, s0);
+		s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), b1, s1);
+	}
+	return hsum256(_mm256_add_ps(s0, s1)) + tail;
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 loadBf16Avx2(const uint16_t *in)
+{
+	__m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in)));
+	return _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+}
+
+__attribute__((target("avx2,fma")))
+static float dotBf16Avx2(const float *a, const uint16_t *b, size_t n)
+{
+	const size_t vecEnd = n / 16 * 16;
+	float tail = dotBf16Scalar(a + vecEnd, b + vecEnd, n - vecEnd);
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	for (size_t i = 0; i < vecEnd; i += 16)
+	{
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), loadBf16Avx2(b + i), s0);
+		s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), loadBf16Avx2(b + i + 8), s1);
+	}
+	return hsum256(_mm256_add_ps(s0, s1)) + tail;
+}
+
+__attribute__((target("avx2,fma")))
+static void bf16ToF32Avx2(const uint16_t *in, float *out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i, loadBf16Avx2(in + i));
+	bf16ToF32Scalar(in + i, out + i, n - i);
+}
+
+// ====== AVX-512 ======
+
+// GCC's own headers trip the uninitialized warnings on many of these intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+/*
+ * Tails are handled with masked loads instead of scalar loops
+ */
+__attribute__((target("avx512f,avx2,fma")))
+static inline __mmask16 tailMask(size_t remaining)
+{
+	return __mmask16((1u << remaining) - 1);
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static inline float hsum512(__m512 v)
+{
+	v = _mm512_add_ps(v, _mm512_shuffle_f32x4(v, v, 0x4e));
+	return hsum256(_mm512_castps512_ps256(v));
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static float dotAvx512(const float *a, const float *b, size_t n)
+{
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32)
+	{
+		s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+		s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+	}
+	for (; i + 16 <= n; i += 16)
+		s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+	if (i < n)
+	{
+		__mmask16 mask = tailMask(n - i);
+		s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), s1);
+	}
+	return hsum512(_mm512_add_ps(s0, s1));
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static void axpyAvx512(float alpha, const float *x, float *y, size_t n)
+{
+	const __m512 a = _mm512_set1_ps(alpha);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+		_mm512_storeu_ps(y + i, _mm512_fmadd_ps(a, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+	if (i < n)
+	{
+		__mmask16 mask = tailMask(n - i);
+		__m512 res = _mm512_fmadd_ps(a, _mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i));
+		_mm512_mask_storeu_ps(y + i, mask, res);
+	}
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static void dualAxpyAvx512(float alpha, const float *x1, float *y1, float beta, const float *x2, float *y2, size_t n)
+{
+	const __m512 a = _mm512_set1_ps(alpha), b = _mm512_set1_ps(beta);
+	for (size_t i = 0; i < n; i += 16)
+	{
+		__mmask16 mask = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+		__m512 val = _mm512_maskz_loadu_ps(mask, x1 + i);
+		__m512 upd = _mm512_fmadd_ps(b, _mm512_maskz_loadu_ps(mask, x2 + i), _mm512_maskz_loadu_ps(mask, y2 + i));
+		_mm512_mask_storeu_ps(y1 + i, mask, _mm512_fmadd_ps(a, val, _mm512_maskz_loadu_ps(mask, y1 + i)));
+		_mm512_mask_storeu_ps(y2 + i, mask, upd);
+	}
+}
+
+/*
+ * 32 zmm registers hold all 16 accumulators at once
+ */
+__attribute__((target("avx512f,avx2,fma")))
+static void block4x4Avx512(const float *in, size_t inSize, const float *weights,
+						float *out, size_t outStride)
+{
+	__m512 acc[4][4];
+	for (int r = 0; r < 4; ++r)
+		for (int d = 0; d < 4; ++d)
+			acc[r][d] = _mm512_setzero_ps();
+
+	for (size_t src = 0; src < inSize; src += 16)
+	{
+		__mmask16 mask = inSize - src >= 16 ? __mmask16(0xffff) : tailMask(inSize - src);
+		__m512 x[4];
+		for (int r = 0; r < 4; ++r)
+			x[r] = _mm512_maskz_loadu_ps(mask, in + r * inSize + src);
+		for (int d = 0; d < 4; ++d)
+		{
+			__m512 w = _mm512_maskz_loadu_ps(mask, weights + d * inSize + src);
+			for (int r = 0; r < 4; ++r)
+				acc[r][d] = _mm512_fmadd_ps(x[r], w, acc[r][d]);
+		}
+	}
+	for (int r = 0; r < 4; ++r)
+		for (int d = 0; d < 4; ++d)
+			out[r * outStride + d] = hsum512(acc[r][d]);
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static void sigmoidFastAvx512(float *vals, size_t n)
+{
+	const __m512 one = _mm512_set1_ps(1.f);
+	for (size_t i = 0; i < n; i += 16)
+	{
+		__mmask16 mask = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+		__m512 t = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, vals + i), _mm512_set1_ps(-log2e));
+		t = _mm512_min_ps(_mm512_max_ps(t, _mm512_set1_ps(-expClamp)), _mm512_set1_ps(expClamp));
+		__m512 whole = _mm512_roundscale_ps(t, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+		__m512 f = _mm512_sub_ps(t, whole);
+		__m512 poly = _mm512_set1_ps(expPoly[4]);
+		for (int k = 3; k >= 0; --k)
+			poly = _mm512_fmadd_ps(poly, f, _mm512_set1_ps(expPoly[k]));
+		__m512i bits = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvttps_epi32(whole), _mm512_set1_epi32(127)), 23);
+		__m512 e = _mm512_mul_ps(poly, _mm512_castsi512_ps(bits));
+		_mm512_mask_storeu_ps(vals + i, mask, _mm512_div_ps(one, _mm512_add_ps(one, e)));
+	}
+}
+
+/*
+ * VNNI multiplies unsigned by signed bytes and adds each group of four
+ * into 32 bits in one instruction, without intermediate saturation
+ */
+__attribute__((target("avx512vnni,avx512bw,avx512f,avx2,fma")))
+static int32_t dotU8S8Vnni(const uint8_t *a, const int8_t *b, size_t n)
+{
+	__m512i s0 = _mm512_setzero_si512(), s1 = _mm512_setzero_si512();
+	size_t i = 0;
+	for (; i + 128 <= n; i += 128)
+	{
+		s0 = _mm512_dpbusd_epi32(s0, _mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+		s1 = _mm512_dpbusd_epi32(s1, _mm512_loadu_si512(a + i + 64), _mm512_loadu_si512(b + i + 64));
+	}
+	for (; i + 64 <= n; i += 64)
+		s0 = _mm512_dpbusd_epi32(s0, _mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+	if (i < n)
+	{
+		__mmask64 mask = (__mmask64(1) << (n - i)) - 1;
+		s1 = _mm512_dpbusd_epi32(s1, _mm512_maskz_loadu_epi8(mask, a + i), _mm512_maskz_loadu_epi8(mask, b + i));
+	}
+	return _mm512_reduce_add_epi32(_mm512_add_epi32(s0, s1));
+}
+
+/*
+ * Sixteen accumulators and eight operands stay within the 32 zmm registers
+ */
+__attribute__((target("avx512vnni,avx512bw,avx512f,avx2,fma")))
+static void block4x4U8S8Vnni(const uint8_t *in, size_t stride, const int8_t *weights,
+							int32_t *out, size_t outStride)
+{
+	__m512i acc[4][4];
+	for (int r = 0; r < 4; ++r)
+		for (int d = 0; d < 4; ++d)
+			acc[r][d] = _mm512_setzero_si512();
+	for (size_t i = 0; i < stride; i += 64)
+	{
+		__m512i a[4], w[4];
+		for (int r = 0; r < 4; ++r)
+			a[r] = _mm512_loadu_si512(in + r * stride + i);
+		for (int d = 0; d < 4; ++d)
+			w[d] = _mm512_loadu_si512(weights + d * stride + i);
+		for (int r = 0; r < 4; ++r)
+			for (int d = 0; d < 4; ++d)
+				acc[r][d] = _mm512_dpbusd_epi32(acc[r][d], a[r], w[d]);
+	}
+	for (int r = 0; r < 4; ++r)
+		for (int d = 0; d < 4; ++d)
+			out[r * outStride + d] = _mm512_reduce_add_epi32(acc[r][d]);
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static void f16ToF32Avx512(const uint16_t *in, float *out, size_t n)
+{
+	const size_t vecEnd = n / 16 * 16;
+	f16ToF32Scalar(in + vecEnd, out + vecEnd, n - vecEnd);
+	for (size_t i = 0; i < vecEnd; i += 16)
+		_mm512_storeu_ps(out + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i))));
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static inline __m512 loadBf16Avx512(const uint16_t *in)
+{
+	__m512i wide = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in)));
+	return _mm512_castsi512_ps(_mm512_slli_epi32(wide, 16));
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static void bf16ToF32Avx512(const uint16_t *in, float *out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+		_mm512_storeu_ps(out + i, loadBf16Avx512(in + i));
+	bf16ToF32Scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static float dotF16Avx512(const float *a, const uint16_t *b, size_t n)
+{
+	const size_t vecEnd = n / 32 * 32;
+	float tail = dotF16Scalar(a + vecEnd, b + vecEnd, n - vecEnd);
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+	for (size_t i = 0; i < vecEnd; i += 32)
+	{
+		__m512 b0 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+		__m512 b1 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i + 16)));
+		s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), b0, s0);
+		s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), b1, s1);
+	}
+	return hsum512(_mm512_add_ps(s0, s1)) + tail;
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static float dotBf16Avx512(const float *a, const uint16_t *b, size_t n)
+{
+	const size_t vecEnd = n / 32 * 32;
+	float tail = dotBf16Scalar(a + vecEnd, b + vecEnd, n - vecEnd);
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+	for (size_t i = 0; i < vecEnd; i += 32)
+	{
+		s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), loadBf16Avx512(b + i), s0);
+		s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), loadBf16Avx512(b + i + 16), s1);
+	}
+	return hsum512(_mm512_add_ps(s0, s1)) + tail;
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+// ====== Dispatch ======
+
+static Isa detectIsa()
+{
+#ifdef SCIOD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return Isa::Avx512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return Isa::Avx2;
+	if (__builtin_cpu_supports("sse2"))
+		return Isa::Sse;
+#endif
+	return Isa::Scalar;
+}
+
+// Every AVX2 chip has F16C in practice, but it is a separate flag
+static bool hasF16c()
+{
+#ifdef SCIOD_X86
+	unsigned a, b, c, d;
+	return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_F16C);
+#else
+	return false;
+#endif
+}
+
+/*
+ * The SCIOD_ISA environment variable may only lower the detected level
+ */
+static Isa chooseIsa()
+{
+	Isa isa = detectIsa();
+	const char *env = getenv("SCIOD_ISA");
+	if (!env)
+		return isa;
+	for (Isa i : {Isa::Scalar, Isa::Sse, Isa::Avx2, Isa::Avx512})
+		if (strcmp(env, isaName(i)) == 0 && i < isa)
+			return i;
+	return isa;
+}
+
+static KernelTable makeTable(Isa isa)
+{
+	switch (isa)
+	{
+#ifdef SCIOD_X86
+		case Isa::Avx512:
+		{
+			// VNNI came after the first AVX-512 chips
+			bool vnni = __builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw");
+			return {isa, dotAvx512, axpyAvx512, dualAxpyAvx512, block4x4Avx512, sigmoidFastAvx512,
+					vnni ? dotU8S8Vnni : dotU8S8Avx2, vnni ? block4x4U8S8Vnni : block4x4U8S8Avx2,
+					f16ToF32Avx512, bf16ToF32Avx512, dotF16Avx512, dotBf16Avx512};
+		}
+		case Isa::Avx2:
+			return {isa, dotAvx2, axpyAvx2, dualAxpyAvx2, block4x4Avx2, sigmoidFastAvx2,
+					dotU8S8Avx2, block4x4U8S8Avx2, hasF16c() ? f16ToF32Avx2 : f16ToF32Scalar, bf16ToF32Avx2,
+					hasF16c() ? dotF16Avx2 : dotF16Scalar, dotBf16Avx2};
+		case Isa::Sse:
+			return {isa, dotSse, axpySse, dualAxpySse, block4x4Sse, sigmoidFastSse,
+					dotU8S8Sse, block4x4U8S8FromDot<dotU8S8Sse>, f16ToF32Scalar, bf16ToF32Sse,
+					dotF16Scalar, dotBf16Scalar};
+#endif
+		default:
+			return {Isa::Scalar, dotScalar, axpyScalar, dualAxpyScalar, block4x4Scalar, sigmoidFastScalar,
+					dotU8S8Scalar, block4x4U8S8FromDot<dotU8S8Scalar>, f16ToF32Scalar, bf16ToF32Scalar,
+					dotF16Scalar, dotBf16Scalar};
+	}
+}
+
+static const KernelTable &kernels()
+{
+	static const KernelTable table = makeTable(chooseIsa());
+	return table;
+}
+
+Isa activeIsa()
+{
+	return kernels().isa;
+}
+
+const char *isaName(Isa isa)
+{
+	switch (isa)
+	{
+		case Isa::Sse:
+			return "sse";
+		case Isa::Avx2:
+			return "avx2";
+		case Isa::Avx512:
+			return "avx512";
+		default:
+			return "scalar";
+	}
+}
+
+float dot(const float *a, const float *b, size_t n)
+{
+	return kernels().dot(a, b, n);
+}
+
+void axpy(float alpha, const float *x, float *y, size_t n)
+{
+	kernels().axpy(alpha, x, y, n);
+}
+
+void dualAxpy(float alpha, const float *x1, float *y1, float beta, const float *x2, float *y2, size_t n)
+{
+	kernels().dualAxpy(alpha, x1, y1, beta, x2, y2, n);
+}
+
+int32_t dotU8S8(const uint8_t *a, const int8_t *b, size_t n)
+{
+	return kernels().dotU8S8(a, b, n);
+}
+
+void halfToFloat(const uint16_t *in, float *out, size_t n, WeightType type)
+{
+	assert(type != WeightType::F32);
+	if (type == WeightType::F16)
+		kernels().f16ToF32(in, out, n);
+	else
+		kernels().bf16ToF32(in, out, n);
+}
+
+/*
+ * Both round to nearest even. Values too large for half become infinity
+ */
+uint16_t floatToHalf(float val, WeightType type)
+{
+	assert(type != WeightType::F32);
+	uint32_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t absBits = bits & 0x7fffffff;
+
+	if (type == WeightType::BF16)
+	{
+		if (absBits > 0x7f800000)
+			return uint16_t((bits >> 16) | 0x40); // Keep NaN quiet instead of rounding to infinity
+		bits += 0x7fff + ((bits >> 16) & 1);
+		return uint16_t(bits >> 16);
+	}
+
+	if (absBits >= 0x7f800000)
+		return uint16_t(sign | 0x7c00 | (absBits > 0x7f800000 ? 0x200 : 0));
+	if (absBits >= 0x477ff000) // Halfway past the largest half, 65504
+		return uint16_t(sign | 0x7c00);
+	if (absBits < 0x38800000) // Below the smallest normal half, 2^-14
+	{
+		float absVal;
+		memcpy(&absVal, &absBits, sizeof(absVal));
+		return uint16_t(sign | uint32_t(lrintf(absVal * 16777216.f)));
+	}
+	uint32_t half = (absBits - 0x38000000) >> 13;
+	uint32_t rest = absBits & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		++half;
+	return uint16_t(sign | half);
+}
+
+void sigmoidExact(float *vals, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		vals[i] = 1.f / (1.f + exp(-vals[i]));
+}
+
+void sigmoidFast(float *vals, size_t n)
+{
+	kernels().sigmoidFast(vals, n);
+}
+
+void denseForward(const float *in, size_t numRows, size_t inSize,
+				const float *weights, const float *biases, size_t outSize,
+				float *out)
+{
+	const KernelTable &table = kernels();
+
+	// Rows of the input are processed in tiles small enough to stay in cache
+	// while every weight row is streamed across them
+	const size_t rowTile = 64;
+	for (size_t tileStart = 0; tileStart < numRows; tileStart += rowTile)
+	{
+		size_t tileEnd = min(numRows, tileStart + rowTile);
+		size_t dest = 0;
+		for (; dest + 4 <= outSize; dest += 4)
+		{
+			const float *w = weights + dest * inSize;
+			size_t r = tileStart;
+			for (; r + 4 <= tileEnd; r += 4)
+				table.block4x4(in + r * inSize, inSize, w, out + r * outSize + dest, outSize);
+			for (; r < tileEnd; ++r)
+				for (size_t d = dest; d < dest + 4; ++d)
+					out[r * outSize + d] = table.dot(in + r * inSize, weights + d * inSize, inSize);
+		}
+		for (; dest < outSize; ++dest)
+			for (size_t r = tileStart; r < tileEnd; ++r)
+				out[r * outSize + dest] = table.dot(in + r * inSize, weights + dest * inSize, inSize);
+
+		for (size_t r = tileStart; r < tileEnd; ++r)
+			for (size_t d = 0; d < outSize; ++d)
+				out[r * outSize + d] += biases[d];
+	}
+}
+
+void denseForwardU8S8(const uint8_t *in, size_t numRows, size_t stride,
+					const int8_t *weights, size_t outSize, int32_t *out)
+{
+	assert(stride % 64 == 0);
+	const KernelTable &table = kernels();
+
+	// Same tiling as denseForward
+	const size_t rowTile = 64;
+	for (size_t tileStart = 0; tileStart < numRows; tileStart += rowTile)
+	{
+		size_t tileEnd = min(numRows, tileStart + rowTile);
+		size_t dest = 0;
+		for (; dest + 4 <= outSize; dest += 4)
+		{
+			const int8_t *w = weights + dest * stride;
+			size_t r = tileStart;
+			for (; r + 4 <= tileEnd; r += 4)
+				table.block4x4U8S8(in + r * stride, stride, w, out + r * outSize + dest, outSize);
+			for (; r < tileEnd; ++r)
+				for (size_t d = dest; d < dest + 4; ++d)
+					out[r * outSize + d] = table.dotU8S8(in + r * stride, weights + d * stride, stride);
+		}
+		for (; dest < outSize; ++dest)
+			for (size_t r = tileStart; r < tileEnd; ++r)
+				out[r * outSize + dest] = table.dotU8S8(in + r * stride, weights + dest * stride, stride);
+	}
+}
+
+/*
+ * Tiles of at least four rows widen groups of four weight rows into a
+ * small float buffer that stays in cache, then use the same block kernel
+ * as denseForward. Fewer rows than that would not pay for the widening,
+ * so they take each product straight from the 16 bit weights
+ */
+void denseForwardHalf(const float *in, size_t numRows, size_t inSize,
+					const uint16_t *weights, WeightType type, const float *biases, size_t outSize,
+					float *out)
+{
+	assert(type != WeightType::F32);
+	const KernelTable &table = kernels();
+	const auto dotHalf = type == WeightType::F16 ? table.dotF16 : table.dotBf16;
+	static thread_local AlignedFloatVec rowBuf;
+	if (rowBuf.size() < 4 * inSize)
+		rowBuf.resize(4 * inSize);
+	float *w = rowBuf.data();
+
+	const size_t rowTile = 64;
+	for (size_t tileStart = 0; tileStart < numRows; tileStart += rowTile)
+	{
+		size_t tileEnd = min(numRows, tileStart + rowTile);
+		size_t dest = 0;
+		if (tileEnd - tileStart >= 4)
+		{
+			for (; dest + 4 <= outSize; dest += 4)
+			{
+				halfToFloat(weights + dest * inSize, w, 4 * inSize, type);
+				size_t r = tileStart;
+				for (; r + 4 <= tileEnd; r += 4)
+					table.block4x4(in + r * inSize, inSize, w, out + r * outSize + dest, outSize);
+				for (; r < tileEnd; ++r)
+					for (size_t d = 0; d < 4; ++d)
+						out[r * outSize + dest + d] = table.dot(in + r * inSize, w + d * inSize, inSize);
+			}
+		}
+		for (; dest < outSize; ++dest)
+			for (size_t r = tileStart; r < tileEnd; ++r)
+				out[r * outSize + dest] = dotHalf(in + r * inSize, weights + dest * inSize, inSize);
+
+		for (size_t r = tileStart; r < tileEnd; ++r)
+			for (size_t d = 0; d < outSize; ++d)
+				out[r * outSize + d] += biases[d];
+	}
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstdint>
+#include "sciod/FloatVec.hpp"
+
+/*
+ * Dense linear algebra kernels shared by the forward and backward passes
+ * Internal to the library: not installed with the public headers
+ *
+ * Each kernel has SSE, AVX2 and AVX-512 versions on x86 plus a portable
+ * scalar one. The widest set the CPU supports is picked once at startup;
+ * setting SCIOD_ISA to scalar, sse, avx2 or avx512 overrides the choice
+ */
+namespace sciod
+{
+	enum class Isa
+	{
+		Scalar,
+		Sse,
+		Avx2,
+		Avx512
+	};
+
+	Isa activeIsa();
+	const char *isaName(Isa isa);
+
+	// Returns sum of a[i] * b[i]
+	float dot(const float *a, const float *b, size_t n);
+
+	// y[i] += alpha * x[i]
+	void axpy(float alpha, const float *x, float *y, size_t n);
+
+	/*
+	 * y1[i] += alpha * x1[i] and y2[i] += beta * x2[i] in a single pass
+	 * x1 may alias y2, letting one walk over a weight row both read the
+	 * old weights and write the new ones
+	 */
+	void dualAxpy(float alpha, const float *x1, float *y1, float beta, const float *x2, float *y2, size_t n);
+
+	// Returns sum of a[i] * b[i], accumulated exactly in 32 bits
+	int32_t dotU8S8(const uint8_t *a, const int8_t *b, size_t n);
+
+	// Widens n 16 bit values of an F16 or BF16 type to float
+	void halfToFloat(const uint16_t *in, float *out, size_t n, WeightType type);
+
+	// Rounds val to the nearest F16 or BF16 value
+	uint16_t floatToHalf(float val, WeightType type);
+
+	// vals[i] = 1 / (1 + exp(-vals[i])) using the libm exp
+	void sigmoidExact(float *vals, size_t n);
+
+	// Polynomial approximation of sigmoidExact, max absolute error 5e-6
+	void sigmoidFast(float *vals, size_t n);
+
+	/*
+	 * out[r][d] = dot(in[r], weights[d]) + biases[d]
+	 * for numRows row-major input rows of inSize values and a
+	 * row-major weight matrix with outSize rows of inSize values
+	 */
+	void denseForward(const float *in, size_t numRows, size_t inSize,
+					const float *weights, const float *biases, size_t outSize,
+					float *out);
+
+	/*
+	 * out[r][d] = dotU8S8(in[r], weights[d]) for numRows input rows and
+	 * outSize weight rows, each row stride bytes long
+	 * stride must be a multiple of 64; pad rows with zero weights
+	 */
+	void denseForwardU8S8(const uint8_t *in, size_t numRows, size_t stride,
+						const int8_t *weights, size_t outSize, int32_t *out);
+
+	// denseForward with weights stored as F16 or BF16
+	void denseForwardHalf(const float *in, size_t numRows, size_t inSize,
+						const uint16_t *weights, WeightType type, const float *biases, size_t outSize,
+						float *out);
+}
@@ -1,51 +1,144 @@
 #include <cassert>
+#include <cstdlib>
+#include <algorithm>
 #include "sciod/Layer.hpp"
+#include "Kernels.hpp"
+
+using namespace std;
 
 namespace sciod
 {
 
-Layer::Layer(int prevSize, int size) : nodes(size, Node(prevSize)) { }
+static float randFloat(float min, float max)
+{
+	return min + ((max - min) * rand()) / RAND_MAX;
+}
+
+LayerGradient::LayerGradient(const Layer &layer) :
+weights(layer.numNodes() * layer.numPrevNodes(), 0.f), biases(layer.numNodes(), 0.f) { }
+
+void LayerGradient::clear()
+{
+	fill(weights.begin(), weights.end(), 0.f);
+	fill(biases.begin(), biases.end(), 0.f);
+}
+
+void LayerGradient::add(const LayerGradient &other)
+{
+	assert(other.weights.size() == weights.size() && other.biases.size() == biases.size());
+	axpy(1.f, other.weights.data(), weights.data(), weights.size());
+	axpy(1.f, other.biases.data(), biases.data(), biases.size());
+}
+
+Layer::Layer(int prevSize, int size, Activation activation) : prevSize(prevSize), size(size),
+activation(activation), weightStorage(prevSize * size, 0.f), biasStorage(size, 0.f),
+weights(weightStorage.data()), biases(biasStorage.data()) { }
+
+Layer::Layer(int prevSize, int size, Activation activation, float *weights, float *biases,
+			shared_ptr<void> mapping) :
+prevSize(prevSize), size(size), activation(activation),
+weights(weights), biases(biases), mapping(move(mapping)) { }
+
+Layer::Layer(const Layer &other) : prevSize(other.prevSize), size(other.size), activation(other.activation),
+weightStorage(other.weights, other.weights + other.prevSize * other.size),
+biasStorage(other.biases, other.biases + other.size),
+weights(weightStorage.data()), biases(biasStorage.data()) { }
+
+Layer &Layer::operator=(const Layer &other)
+{
+	Layer copy(other);
+	return *this = move(copy);
+}
 
 size_t Layer::numNodes() const
 {
-	return nodes.size();
+	return size;
 }
 
 size_t Layer::numPrevNodes() const
 {
-	assert(nodes.size() > 0);
-	return nodes[0].numLinks();
+	assert(size > 0);
+	return prevSize;
 }
 
 void Layer::randomize()
 {
-	for (auto &i : nodes)
-		i.randomize();
+	for (size_t i = 0; i < prevSize * size; ++i)
+		weights[i] = randFloat(-1.f, 1.f);
+}
+
+Activation Layer::getActivation() const
+{
+	return activation;
+}
+
+void Layer::setActivation(Activation act)
+{
+	activation = act;
 }
 
 float Layer::getBias(size_t id) const
 {
-	assert(id < nodes.size());
-	return nodes[id].getBias();
+	assert(id < size);
+	return biases[id];
 }
 
 void Layer::updateBiases(const FloatVec &outputs, float learningRate)
 {
-	assert(outputs.size() == nodes.size());
+	assert(outputs.size() == size);
 	for (size_t i = 0; i < outputs.size(); ++i)
-		nodes[i].updateBias(outputs[i], learningRate);
+		biases[i] -= outputs[i] * learningRate;
 }
 
 float &Layer::getLinkRef(size_t src, size_t dest)
 {
-	assert(dest < nodes.size());
-	return nodes[dest].getLinkRef(src);
+	assert(src < prevSize && dest < size);
+	return weights[dest * prevSize + src];
 }
 
 float Layer::getLink(size_t src, size_t dest) const
 {
-	assert(dest < nodes.size());
-	return nodes[dest].getLink(src);
+	assert(src < prevSize && dest < size);
+	return weights[dest * prevSize + src];
+}
+
+void Layer::applyGradient(const LayerGradient &grad, float learningRate, float biasRate)
+{
+	assert(grad.weights.size() == prevSize * size && grad.biases.size() == size);
+	axpy(-learningRate, grad.weights.data(), weights, grad.weights.size());
+	axpy(-biasRate, grad.biases.data(), biases, grad.biases.size());
+}
+
+const float *Layer::getRow(size_t dest) const
+{
+	assert(dest < size);
+	return weights + dest * prevSize;
+}
+
+float *Layer::getRow(size_t dest)
+{
+	assert(dest < size);
+	return weights + dest * prevSize;
+}
+
+const float *Layer::getWeights() const
+{
+	return weights;
+}
+
+float *Layer::getWeights()
+{
+	return weights;
+}
+
+const float *Layer::getBiases() const
+{
+	return biases;
+}
+
+float *Layer::getBiases()
+{
+	return biases;
 }
 
 }
@@ -0,0 +1,181 @@
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include "sciod/Model.hpp"
+
+using namespace std;
+
+namespace sciod
+{
+
+static_assert(ATOMIC_POINTER_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2,
+			  "Trainer::getModel relies on lock free atomics");
+
+static NeuralNet withoutOptimizer(NeuralNet &&net)
+{
+	net.resetOptimizer();
+	return move(net);
+}
+
+// Optimizer state is only needed to keep training, so snapshots drop it
+Model::Model(const NeuralNet &net, long version) : net(net.copyWeights()), version(version) { }
+
+Model::Model(NeuralNet &&net, long version) : net(withoutOptimizer(move(net))), version(version) { }
+
+const NeuralNet &Model::getNet() const
+{
+	return net;
+}
+
+long Model::getVersion() const
+{
+	return version;
+}
+
+size_t Model::getNumInputs() const
+{
+	return net.getNumInputs();
+}
+
+size_t Model::getNumOutputs() const
+{
+	return net.getNumOutputs();
+}
+
+FloatVec Model::calcProb(const FloatVec &inputVals) const
+{
+	return net.calcProb(inputVals);
+}
+
+FloatVec Model::calcProbBatch(const Dataset &data) const
+{
+	return net.calcProbBatch(data);
+}
+
+void Model::calcProb(const float *inputVals, float *outputVals, Workspace &workspace) const
+{
+	net.calcProb(inputVals, outputVals, workspace);
+}
+
+void Model::calcProbBatch(const float *inputRows, size_t numRows, float *outputRows, Workspace &workspace) const
+{
+	net.calcProbBatch(inputRows, numRows, outputRows, workspace);
+}
+
+Trainer::Trainer(const NeuralNet &net) : net(net), current(&slots[0])
+{
+	publish();
+}
+
+NeuralNet &Trainer::getNet()
+{
+	return net;
+}
+
+ModelPtr Trainer::getModel() const
+{
+	while (1)
+	{
+		Slot *slot = current.load();
+		slot->readers.fetch_add(1);
+
+		// Registered as a reader before the check, so once the slot is
+		// still current, publish cannot touch it until this copy is done
+		if (current.load() == slot)
+		{
+			ModelPtr model = slot->model;
+			slot->readers.fetch_sub(1);
+			return model;
+		}
+		slot->readers.fetch_sub(1);
+	}
+}
+
+void Trainer::setPublishInterval(long epochs)
+{
+	publishInterval = epochs;
+}
+
+static void waitForReaders(const atomic<long> &readers)
+{
+	while (readers.load() != 0)
+		this_thread::yield();
+}
+
+void Trainer::publish()
+{
+	lock_guard<mutex> lock(publishMutex);
+	ModelPtr next = make_shared<Model>(net, version++);
+	Slot *retired = current.load();
+	Slot *spare = retired == &slots[0] ? &slots[1] : &slots[0];
+
+	// Readers can only be on the spare slot briefly, after losing a race
+	waitForReaders(spare->readers);
+	spare->model = move(next);
+	current.store(spare);
+
+	// Drop the slot's reference so the old model lives only as long as
+	// the readers holding it
+	waitForReaders(retired->readers);
+	retired->model.reset();
+}
+
+/*
+ * Piggybacks publishing on the observer, which training already calls
+ * between epochs. The caller's observer still sees reports on its own
+ * interval, with throughput measured over that whole interval
+ */
+TrainConfig Trainer::publishingConfig(const TrainConfig &config)
+{
+	if (publishInterval <= 0)
+		return config;
+
+	struct Reports
+	{
+		double lastWallTime = 0, lastReportTime = 0, samples = 0;
+	};
+	auto reports = make_shared<Reports>();
+	TrainObserver observer = config.observer;
+	const long observeInterval = max<long>(1, config.observeInterval);
+	const long interval = publishInterval;
+
+	TrainConfig adjusted = config;
+	adjusted.observeInterval = 1;
+	adjusted.observer = [this, reports, observer, observeInterval, interval](const EpochStats &stats)
+	{
+		if (stats.epoch % interval == 0)
+			publish();
+		if (!observer)
+			return;
+
+		reports->samples += stats.samplesPerSec * (stats.wallTime - reports->lastWallTime);
+		reports->lastWallTime = stats.wallTime;
+		if (stats.epoch % observeInterval == 0)
+		{
+			EpochStats combined = stats;
+			double elapsed = stats.wallTime - reports->lastReportTime;
+			combined.samplesPerSec = elapsed > 0 ? reports->samples / elapsed : 0;
+			observer(combined);
+			reports->lastReportTime = stats.wallTime;
+			reports->samples = 0;
+		}
+	};
+	return adjusted;
+}
+
+BackPropResult Trainer::train(const Dataset &data, const TrainConfig &config)
+{
+	BackPropResult result = net.backPropagate(data, publishingConfig(config));
+	publish();
+	return result;
+}
+
+BackPropResult Trainer::train(DataSource &source, const TrainConfig &config)
+{
+	BackPropResult result = net.backPropagate(source, publishingConfig(config));
+	publish();
+	return result;
+}
+
+}
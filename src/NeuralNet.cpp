@@ -4,30 +4,83 @@
 #include <cassert>
 #include <valarray>
 #include <sstream>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+#include <limits>
 #include "sciod/NeuralNet.hpp"
+#include "Kernels.hpp"
+#include "ThreadPool.hpp"
+#include "Optimizer.hpp"
 
 using namespace std;
 
 namespace sciod
 {
 
-float squash(float val)
+NeuralNet::NeuralNet() = default;
+
+NeuralNet::NeuralNet(const NeuralNet &other) :
+layers(other.layers), sigmoidMode(other.sigmoidMode),
+optimizer(other.optimizer ? new Optimizer(*other.optimizer) : nullptr) { }
+
+NeuralNet::NeuralNet(NeuralNet &&other) = default;
+
+NeuralNet &NeuralNet::operator=(const NeuralNet &other)
 {
-	return 1.f / (1 + exp(-val));
+	NeuralNet copy(other);
+	return *this = move(copy);
 }
 
+NeuralNet &NeuralNet::operator=(NeuralNet &&other) = default;
+
+NeuralNet::~NeuralNet() = default;
+
 NeuralNet::NeuralNet(int numInputs, int numHidden, int numHidLayers, int numOutputs)
 {
 	create(numInputs, numHidden, numHidLayers, numOutputs);
 }
 
+NeuralNet::NeuralNet(const vector<size_t> &topology)
+{
+	create(topology);
+}
+
+NeuralNet NeuralNet::fromTopology(const vector<size_t> &topology)
+{
+	return NeuralNet(topology);
+}
+
 void NeuralNet::create(int numInputs, int numHidden, int numHidLayers, int numOutputs)
 {
+	vector<size_t> topology(1, numInputs);
+	for (int i = 0; i < max(numHidLayers, 1); ++i)
+		topology.push_back(numHidden);
+	topology.push_back(numOutputs);
+	create(topology);
+}
+
+/*
+ * Builds a net with the given width of each layer, inputs first and
+ * outputs last, so {784, 256, 64, 10} has two hidden layers
+ */
+void NeuralNet::create(const vector<size_t> &topology)
+{
+	assert(topology.size() >= 2);
 	layers.clear();
-	layers.emplace_back(numInputs, numHidden);
-	for (int i = 0; i < numHidLayers - 1; ++i)
-		layers.emplace_back(numHidden, numHidden);
-	layers.emplace_back(numHidden, numOutputs);
+	optimizer.reset();
+	for (size_t i = 1; i < topology.size(); ++i)
+		layers.emplace_back(topology[i - 1], topology[i]);
+}
+
+vector<size_t> NeuralNet::getTopology() const
+{
+	vector<size_t> topology(1, getNumInputs());
+	for (auto &i : layers)
+		topology.push_back(i.numNodes());
+	return topology;
 }
 
 string NeuralNet::toString() const
@@ -36,12 +89,17 @@ string NeuralNet::toString() const
 	const char endChar = 'z';
 	const int numChars = endChar - startChar;
 
+	// Index of the first node of each layer when all are numbered in order
+	vector<size_t> firstNode(1, 0);
+	for (size_t width : getTopology())
+		firstNode.push_back(firstNode.back() + width);
+
 	/*
 	 * Returns a string unique to that position
 	 */
 	auto nodeStr = [&](int layerId, int nodeNum) -> string
 	{
-		int diff = min(layerId, 1) * getNumInputs() + max(0, layerId - 1) * layers[1].numNodes() + nodeNum;
+		int diff = firstNode[layerId] + nodeNum;
 		if (diff > numChars)
 			return string() + char(startChar + diff / numChars - 1) + char(startChar + diff % numChars);
 		return string() + char(startChar + diff);
@@ -80,6 +138,50 @@ string NeuralNet::toString() const
 	return ss.str();
 }
 
+size_t NeuralNet::getNumLayers() const
+{
+	return layers.size();
+}
+
+const Layer &NeuralNet::getLayer(size_t layerId) const
+{
+	assert(layerId < layers.size());
+	return layers[layerId];
+}
+
+Layer &NeuralNet::getLayer(size_t layerId)
+{
+	assert(layerId < layers.size());
+	return layers[layerId];
+}
+
+/*
+ * Layer 0 is the first hidden layer, the last one is the output
+ * Softmax may only be used on the output layer
+ */
+void NeuralNet::setActivation(size_t layerId, Activation act)
+{
+	assert(layerId < layers.size());
+	assert(act != Activation::Softmax || layerId + 1 == layers.size());
+	layers[layerId].setActivation(act);
+}
+
+Activation NeuralNet::getActivation(size_t layerId) const
+{
+	assert(layerId < layers.size());
+	return layers[layerId].getActivation();
+}
+
+void NeuralNet::setSigmoidMode(SigmoidMode mode)
+{
+	sigmoidMode = mode;
+}
+
+SigmoidMode NeuralNet::getSigmoidMode() const
+{
+	return sigmoidMode;
+}
+
 size_t NeuralNet::getNumInputs() const
 {
 	return layers.size() == 0 ? 0 : layers[0].numPrevNodes();
@@ -102,8 +204,7 @@ float NeuralNet::calcNode(const Layer &row, const FloatVec &prevVals, int dest)
 {
 	float activation = 0.f;
 	assert(prevVals.size() == row.numPrevNodes());
-	for (size_t src = 0; src < prevVals.size(); ++src)
-		activation += prevVals[src] * row.getLink(src, dest);
+	activation += dot(prevVals.data(), row.getRow(dest), prevVals.size());
 	activation += row.getBias(dest);
 	return activation;
 }
@@ -112,115 +213,670 @@ FloatVec NeuralNet::calcLayerOutputs(const Layer &row, const FloatVec &prevVals)
 {
 	FloatVec nextVals(row.numNodes(), 0.f);
 	for (size_t dest = 0; dest < row.numNodes(); ++dest)
-		nextVals[dest] = squash(calcNode(row, prevVals, dest));
+		nextVals[dest] = calcNode(row, prevVals, dest);
+	activate(row.getActivation(), nextVals.data(), 1, nextVals.size(), sigmoidMode);
 	return nextVals;
 }
 
-// Returns initial error
+void NeuralNet::calcLayerOutputsBatch(const Layer &row, const float *prevVals, size_t numRows, float *outVals) const
+{
+	denseForward(prevVals, numRows, row.numPrevNodes(), row.getWeights(), row.getBiases(), row.numNodes(), outVals);
+	activate(row.getActivation(), outVals, numRows, row.numNodes(), sigmoidMode);
+}
 
-float NeuralNet::backPropagateStep(const FloatVecIO &vals, float learningRate)
+/*
+ * Calculates the error derivative at the input of every output node
+ * Softmax outputs use cross-entropy, everything else squared error
+ * Returns the loss
+ */
+float NeuralNet::calcOutputDeltas(const float *outputs, const float *correctVals, float *deltas) const
 {
+	const Activation act = layers.back().getActivation();
+	const size_t numOutputs = getNumOutputs();
 
-	assert(vals.out.size() == layers.back().numNodes());
-	FloatVec2D nodeProb = calcProbFull(vals.in);
-	FloatVec2D actDeriv = nodeProb; // Assign to get correct size. Must reassign later
+	float error = 0.f;
+	for (size_t src = 0; src < numOutputs; ++src)
+	{
+		float out = outputs[src];
+		float correct = correctVals[src];
+		float diff = (out - correct);
+		deltas[src] = diff;
+
+		if (act == Activation::Softmax)
+			error -= correct * log(max(out, 1e-30f));
+		else
+			error += diff * diff / 2.f;
+	}
 
-	float error = 0.f; // Only for return value
+	// Softmax and cross-entropy derivatives cancel down to diff
+	if (act != Activation::Softmax)
+		activationDeriv(act, outputs, deltas, numOutputs);
+	return error;
+}
+
+NeuralNet::TrainWorker::TrainWorker(const NeuralNet &net)
+{
+	size_t total = net.getNumInputs();
+	offsets.push_back(0);
+	for (auto &row : net.layers)
+	{
+		offsets.push_back(total);
+		total += row.numNodes();
+	}
+	nodeVals.resize(total);
+	deltas.resize(net.getMaxWidth());
+	chainSums.resize(net.getMaxWidth());
+}
+
+/*
+ * Runs inputVals through the net, keeping every layer's outputs in worker
+ */
+void NeuralNet::forwardStep(const float *inputVals, TrainWorker &worker) const
+{
+	float *nodeVals = worker.nodeVals.data();
+	copy(inputVals, inputVals + getNumInputs(), nodeVals);
+	for (size_t layerId = 0; layerId < layers.size(); ++layerId)
+		calcLayerOutputsBatch(layers[layerId], nodeVals + worker.offsets[layerId], 1,
+							  nodeVals + worker.offsets[layerId + 1]);
+}
+
+// Returns initial error
 
-	assert(nodeProb.size() == 1 + layers.size());
+float NeuralNet::backPropagateStep(const float *inputVals, const float *outputVals, float learningRate, float biasRate, TrainWorker &worker)
+{
+	forwardStep(inputVals, worker);
+	float *deltas = worker.deltas.data(), *chainSums = worker.chainSums.data();
+	float error = calcOutputDeltas(worker.nodeVals.data() + worker.offsets.back(), outputVals, deltas);
 
-	// Calculate activation derivatives for last row
+	/*
+	 * Walk back from the output, streaming each weight row once:
+	 * its contribution to the previous layer's deltas is read from the
+	 * old weights in the same pass that writes the adjusted ones
+	 */
+	for (int layerId = layers.size() - 1; layerId >= 0; --layerId)
 	{
-		int layerId = nodeProb.size() - 1;
-		for (size_t src = 0; src < nodeProb[layerId].size(); ++src)
-		{
-			float out = nodeProb[layerId][src];
-			float correct = vals.out[src];
-			float act = (out - correct) * out * (1 - out);
-			actDeriv[layerId][src] = act;
+		Layer &row = layers[layerId];
+		const float *prevVals = worker.nodeVals.data() + worker.offsets[layerId];
+		const size_t numPrev = row.numPrevNodes();
+		axpy(-biasRate, deltas, row.getBiases(), row.numNodes());
 
-			float diff = (out - correct);
-			error += diff * diff / 2.f;
+		// The inputs have no weights of their own to adjust
+		if (layerId == 0)
+		{
+			for (size_t dest = 0; dest < row.numNodes(); ++dest)
+				axpy(-learningRate * deltas[dest], prevVals, row.getRow(dest), numPrev);
+			break;
 		}
+
+		fill(chainSums, chainSums + numPrev, 0.f);
+		for (size_t dest = 0; dest < row.numNodes(); ++dest)
+			dualAxpy(deltas[dest], row.getRow(dest), chainSums,
+					-learningRate * deltas[dest], prevVals, row.getRow(dest), numPrev);
+		activationDeriv(layers[layerId - 1].getActivation(), prevVals, chainSums, numPrev);
+		swap(deltas, chainSums);
 	}
 
-	// Calculate for all other rows
-	for (int layerId = nodeProb.size() - 2; layerId >= 0; --layerId)
+	// Calculate error for return value
+	return error;
+}
+
+/*
+ * Adds the weight derivatives for one sample onto worker.grads
+ * Same single walk over each weight row as backPropagateStep, reading
+ * the weights and the matching gradient row side by side
+ * Returns initial error
+ */
+float NeuralNet::accumulateGradient(const float *inputVals, const float *outputVals, TrainWorker &worker) const
+{
+	assert(worker.grads.size() == layers.size());
+	forwardStep(inputVals, worker);
+	float *deltas = worker.deltas.data(), *chainSums = worker.chainSums.data();
+	float error = calcOutputDeltas(worker.nodeVals.data() + worker.offsets.back(), outputVals, deltas);
+
+	for (int layerId = layers.size() - 1; layerId >= 0; --layerId)
 	{
-		Layer &row = layers[layerId];
-		for (size_t src = 0; src < row.numPrevNodes(); ++src)
+		const Layer &row = layers[layerId];
+		LayerGradient &grad = worker.grads[layerId];
+		const float *prevVals = worker.nodeVals.data() + worker.offsets[layerId];
+		const size_t numPrev = row.numPrevNodes();
+		for (size_t dest = 0; dest < row.numNodes(); ++dest)
+			grad.biases[dest] += deltas[dest];
+
+		if (layerId == 0)
 		{
-			float chainSums = 0.f;
 			for (size_t dest = 0; dest < row.numNodes(); ++dest)
-				chainSums += row.getLink(src, dest) * actDeriv[layerId + 1][dest];
-			float out = nodeProb[layerId][src];
-			actDeriv[layerId][src] = out * (1 - out) * chainSums;
+				axpy(deltas[dest], prevVals, grad.weights.data() + dest * numPrev, numPrev);
+			break;
 		}
+
+		fill(chainSums, chainSums + numPrev, 0.f);
+		for (size_t dest = 0; dest < row.numNodes(); ++dest)
+			dualAxpy(deltas[dest], row.getRow(dest), chainSums,
+					deltas[dest], prevVals, grad.weights.data() + dest * numPrev, numPrev);
+		activationDeriv(layers[layerId - 1].getActivation(), prevVals, chainSums, numPrev);
+		swap(deltas, chainSums);
 	}
+	return error;
+}
 
-	// Use deriv calculations to adjust link weights
-	for (int layerId = nodeProb.size() - 2; layerId >= 0; --layerId)
+/*
+ * Averages the gradient over the batch and applies one update
+ * With a pool, the batch is split into one contiguous chunk per worker,
+ * each accumulating into its own gradients, which are then summed in
+ * worker order so the result does not depend on thread timing
+ * Returns summed initial error of the batch
+ */
+float NeuralNet::backPropagateBatch(const Dataset &data, size_t begin, size_t end, TrainContext &context)
+{
+	assert(end > begin);
+	const size_t numWorkers = context.pool ? context.pool->numWorkers() : 1;
+	assert(context.workers.size() >= numWorkers);
+	context.data = &data;
+	context.begin = begin;
+	context.end = end;
+
+	if (context.pool)
+		context.pool->run(context.batchTask);
+	else
+		context.batchTask(0);
+
+	vector<TrainWorker> &workers = context.workers;
+	float error = 0.f;
+	for (size_t workerId = 0; workerId < numWorkers; ++workerId)
+	{
+		error += workers[workerId].error;
+		if (workerId > 0)
+			for (size_t layerId = 0; layerId < layers.size(); ++layerId)
+				workers[0].grads[layerId].add(workers[workerId].grads[layerId]);
+	}
+
+	context.optimizer->apply(layers, workers[0].grads, 1.f / (end - begin), context.learningRate);
+	return error;
+}
+
+static inline float relaxedLoad(const float *ptr)
+{
+	float val;
+	__atomic_load(ptr, &val, __ATOMIC_RELAXED);
+	return val;
+}
+
+static inline void relaxedStore(float *ptr, float val)
+{
+	__atomic_store(ptr, &val, __ATOMIC_RELAXED);
+}
+
+/*
+ * Same as backPropagateStep, but safe to run from several threads at once
+ * Shared weights are only touched through relaxed atomic loads and stores,
+ * so concurrent updates may overwrite each other (Hogwild!) but never tear
+ * Returns initial error
+ */
+float NeuralNet::hogwildStep(const float *inputVals, const float *outputVals, float learningRate, float biasRate, TrainWorker &worker)
+{
+	float *nodeVals = worker.nodeVals.data();
+	copy(inputVals, inputVals + getNumInputs(), nodeVals);
+	for (size_t layerId = 0; layerId < layers.size(); ++layerId)
+	{
+		const Layer &row = layers[layerId];
+		const float *prevVals = nodeVals + worker.offsets[layerId];
+		float *nextVals = nodeVals + worker.offsets[layerId + 1];
+		for (size_t dest = 0; dest < row.numNodes(); ++dest)
+		{
+			const float *weights = row.getRow(dest);
+			float activation = relaxedLoad(row.getBiases() + dest);
+			for (size_t src = 0; src < row.numPrevNodes(); ++src)
+				activation += prevVals[src] * relaxedLoad(weights + src);
+			nextVals[dest] = activation;
+		}
+		activate(row.getActivation(), nextVals, 1, row.numNodes(), sigmoidMode);
+	}
+
+	float *deltas = worker.deltas.data(), *chainSums = worker.chainSums.data();
+	float error = calcOutputDeltas(nodeVals + worker.offsets.back(), outputVals, deltas);
+
+	/*
+	 * Deltas for the previous layer come from the weights as loaded before
+	 * this layer's update, like the fused walk in backPropagateStep
+	 */
+	for (int layerId = layers.size() - 1; layerId >= 0; --layerId)
 	{
 		Layer &row = layers[layerId];
-		row.updateBiases(actDeriv[layerId + 1], learningRate * 0.75f);
-		for (size_t src = 0; src < row.numPrevNodes(); ++src)
+		const float *prevVals = nodeVals + worker.offsets[layerId];
+		const size_t numPrev = row.numPrevNodes();
+		if (layerId > 0)
+			fill(chainSums, chainSums + numPrev, 0.f);
+		for (size_t dest = 0; dest < row.numNodes(); ++dest)
 		{
-			for (size_t dest = 0; dest < row.numNodes(); ++dest)
+			float *weights = row.getRow(dest);
+			for (size_t src = 0; src < numPrev; ++src)
 			{
-				float &link = row.getLinkRef(src, dest);
-				float deriv = nodeProb[layerId][src] * actDeriv[layerId + 1][dest];
-				link -= learningRate * deriv;
+				float weight = relaxedLoad(weights + src);
+				if (layerId > 0)
+					chainSums[src] += weight * deltas[dest];
+				relaxedStore(weights + src, weight - learningRate * prevVals[src] * deltas[dest]);
 			}
+			float *bias = row.getBiases() + dest;
+			relaxedStore(bias, relaxedLoad(bias) - biasRate * deltas[dest]);
 		}
+		if (layerId == 0)
+			break;
+		activationDeriv(layers[layerId - 1].getActivation(), prevVals, chainSums, numPrev);
+		swap(deltas, chainSums);
 	}
+	return error;
+}
 
-	// Calculate error for return value
+/*
+ * Every worker walks its own interleaved share of the samples,
+ * updating the shared weights without any locks or reduction
+ * Returns summed initial error of the epoch
+ */
+float NeuralNet::hogwildEpoch(const Dataset &data, TrainContext &context)
+{
+	context.data = &data;
+	if (context.pool)
+		context.pool->run(context.hogwildTask);
+	else
+		context.hogwildTask(0);
+
+	float error = 0.f;
+	for (auto &worker : context.workers)
+		error += worker.error;
 	return error;
 }
 
-vector<FloatVecIO> NeuralNet::resolveConflicts(vector<FloatVecIO> vals)
+namespace
 {
-	for (auto it = vals.begin(); it != vals.end(); ++it)
-		for (auto jt = it + 1; jt != vals.end();)
+	// A row of input values, hashed and compared by value
+	struct RowKey
+	{
+		const float *vals;
+		size_t size;
+	};
+
+	struct RowKeyHash
+	{
+		size_t operator()(const RowKey &key) const
 		{
-			if (it->in == jt->in)
+			// FNV-1a over the bits of each value. 0 and -0 compare
+			// equal, so they must hash the same
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < key.size; ++i)
 			{
-				for (size_t i = 0; i < jt->out.size(); ++i)
-					if (jt->out[i] > it->out[i])
-						it->out[i] = jt->out[i];
-				jt = vals.erase(jt);
-				continue;
+				uint32_t bits = 0;
+				if (key.vals[i] != 0.f)
+					memcpy(&bits, &key.vals[i], sizeof(bits));
+				hash = (hash ^ bits) * 1099511628211ull;
 			}
-			++jt;
+			return hash;
 		}
-	return vals;
+	};
+
+	struct RowKeyEqual
+	{
+		bool operator()(const RowKey &a, const RowKey &b) const
+		{
+			return a.size == b.size && equal(a.vals, a.vals + a.size, b.vals);
+		}
+	};
+
+	using RowIndexMap = unordered_map<RowKey, size_t, RowKeyHash, RowKeyEqual>;
+
+	void mergeOutputs(const float *outputVals, float *merged, size_t numOutputs)
+	{
+		for (size_t i = 0; i < numOutputs; ++i)
+			if (outputVals[i] > merged[i])
+				merged[i] = outputVals[i];
+	}
+}
+
+/*
+ * Merges samples with identical inputs into the first of them,
+ * keeping the largest value of each output
+ * Runs in a single pass using a hash of the inputs
+ */
+vector<FloatVecIO> NeuralNet::resolveConflicts(const vector<FloatVecIO> &vals)
+{
+	vector<FloatVecIO> merged;
+	RowIndexMap indices(vals.size());
+	for (auto &i : vals)
+	{
+		auto found = indices.find({i.in.data(), i.in.size()});
+		if (found == indices.end())
+		{
+			indices.emplace(RowKey{i.in.data(), i.in.size()}, merged.size());
+			merged.push_back(i);
+			continue;
+		}
+		FloatVec &out = merged[found->second].out;
+		mergeOutputs(i.out.data(), out.data(), out.size());
+	}
+	return merged;
+}
+
+Dataset NeuralNet::resolveConflicts(const Dataset &data)
+{
+	Dataset merged(data.getNumInputs(), data.getNumOutputs());
+	RowIndexMap indices(data.size());
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		RowKey key = {data.getInputs(i), data.getNumInputs()};
+		auto found = indices.find(key);
+		if (found == indices.end())
+		{
+			indices.emplace(key, merged.size());
+			merged.addRow(data.getInputs(i), data.getOutputs(i));
+			continue;
+		}
+		mergeOutputs(data.getOutputs(i), merged.getOutputs(found->second), data.getNumOutputs());
+	}
+	return merged;
 }
 
 /* 
  * Returns Epoch
  */
 BackPropResult NeuralNet::backPropagate(const vector<FloatVecIO> &vals, float maxError, float learningRate, bool debug)
+{
+	TrainConfig config;
+	config.maxError = maxError;
+	config.learningRate = learningRate;
+	if (debug)
+	{
+		config.observeInterval = 1024;
+		config.observer = [](const EpochStats &stats)
+		{
+			cout << "Error: " << stats.loss << endl;
+		};
+	}
+	return backPropagate(vals, config);
+}
+
+/*
+ * Threads only pay off when there is a batch or, for hogwild, more than
+ * one sample to split between them
+ * Returns null when training should run on the calling thread alone
+ */
+static ThreadPool *createTrainPool(const TrainConfig &config, size_t maxSamples)
+{
+	const size_t batchSize = max<size_t>(1, config.batchSize);
+	if (config.hogwild && config.numThreads > 1 && maxSamples > 1)
+		return new ThreadPool(min(config.numThreads, maxSamples));
+	if (batchSize > 1 && config.numThreads > 1)
+		return new ThreadPool(min(config.numThreads, batchSize));
+	return nullptr;
+}
+
+BackPropResult NeuralNet::backPropagate(const vector<FloatVecIO> &vals, const TrainConfig &config)
+{
+	return backPropagate(Dataset(vals), config);
+}
+
+BackPropResult NeuralNet::backPropagate(const Dataset &data, const TrainConfig &config)
+{
+	Dataset resolved;
+	if (config.resolveConflicts)
+		resolved = resolveConflicts(data);
+	const Dataset &adjData = config.resolveConflicts ? resolved : data;
+
+	unique_ptr<ThreadPool> pool(createTrainPool(config, adjData.size()));
+	TrainContext context;
+	context.pool = pool.get();
+	context.optimizer = &prepareOptimizer(config.optimizer);
+	prepareTraining(config, context);
+	return trainEpochs(config, [&](size_t &numSamples)
+	{
+		numSamples = adjData.size();
+		return trainSamples(adjData, config, context);
+	});
+}
+
+/*
+ * Trains on samples read from source chunkSize at a time, rewinding it
+ * before every epoch. Conflicting samples are not merged since only one
+ * chunk is in memory at once
+ */
+BackPropResult NeuralNet::backPropagate(DataSource &source, const TrainConfig &config)
+{
+	const size_t batchSize = max<size_t>(1, config.batchSize);
+	const size_t chunkSize = max<size_t>(1, config.chunkSize / batchSize) * batchSize;
+
+	unique_ptr<ThreadPool> pool(createTrainPool(config, chunkSize));
+	TrainContext context;
+	context.pool = pool.get();
+	context.optimizer = &prepareOptimizer(config.optimizer);
+	prepareTraining(config, context);
+	Dataset chunk;
+	return trainEpochs(config, [&](size_t &numSamples)
+	{
+		float err = 0.f;
+		numSamples = 0;
+		source.rewind();
+		while (source.read(chunk, chunkSize) > 0)
+		{
+			numSamples += chunk.size();
+			err += trainSamples(chunk, config, context);
+		}
+		return err;
+	});
+}
+
+void NeuralNet::resetOptimizer()
+{
+	optimizer.reset();
+}
+
+NeuralNet NeuralNet::copyWeights() const
+{
+	NeuralNet copy;
+	copy.layers = layers;
+	copy.sigmoidMode = sigmoidMode;
+	return copy;
+}
+
+/*
+ * Reuses the state of earlier calls when it was built for the same
+ * config and layers, so training can continue across calls
+ */
+Optimizer &NeuralNet::prepareOptimizer(const OptimizerConfig &config)
+{
+	if (!optimizer || !optimizer->matches(config, layers))
+		optimizer.reset(new Optimizer(config, layers));
+	return *optimizer;
+}
+
+/*
+ * Sizes the workers for context.pool and builds the tasks it runs
+ * Each worker takes a contiguous share of a batch, or for hogwild an
+ * interleaved share of all the samples
+ */
+void NeuralNet::prepareTraining(const TrainConfig &config, TrainContext &context)
+{
+	const size_t numWorkers = context.pool ? context.pool->numWorkers() : 1;
+	context.workers.assign(numWorkers, TrainWorker(*this));
+	if (config.shuffle)
+		context.shuffled = Dataset(getNumInputs(), getNumOutputs());
+	bool usesGradients = config.batchSize > 1 || config.optimizer.type != OptimizerType::Sgd;
+	if (usesGradients && !config.hogwild)
+		for (auto &worker : context.workers)
+			for (auto &i : layers)
+				worker.grads.emplace_back(i);
+
+	context.batchTask = [this, &context, numWorkers](size_t workerId)
+	{
+		TrainWorker &worker = context.workers[workerId];
+		for (auto &i : worker.grads)
+			i.clear();
+		worker.error = 0.f;
+		const size_t numSamples = context.end - context.begin;
+		size_t chunkBegin = context.begin + numSamples * workerId / numWorkers;
+		size_t chunkEnd = context.begin + numSamples * (workerId + 1) / numWorkers;
+		for (size_t i = chunkBegin; i < chunkEnd; ++i)
+			worker.error += accumulateGradient(context.data->getInputs(i), context.data->getOutputs(i), worker);
+	};
+
+	context.hogwildTask = [this, &context, numWorkers](size_t workerId)
+	{
+		TrainWorker &worker = context.workers[workerId];
+		const Dataset &data = *context.data;
+		worker.error = 0.f;
+		for (size_t i = workerId; i < data.size(); i += numWorkers)
+			worker.error += hogwildStep(data.getInputs(i), data.getOutputs(i), context.learningRate, context.biasRate, worker);
+	};
+}
+
+/*
+ * Runs one pass over samples with the update rule chosen by config
+ * Returns the summed error of the samples
+ */
+float NeuralNet::trainSamples(const Dataset &samples, const TrainConfig &config, TrainContext &context)
+{
+	const size_t batchSize = max<size_t>(1, config.batchSize);
+	context.learningRate = config.learningRate;
+	context.biasRate = config.learningRate * context.optimizer->getBiasScale();
+
+	// Copies the rows in shuffled order, so batches stay contiguous
+	if (config.shuffle)
+	{
+		samples.shuffledIndices(context.order);
+		context.shuffled.resize(samples.size());
+		for (size_t i = 0; i < samples.size(); ++i)
+		{
+			const size_t row = context.order[i];
+			copy(samples.getInputs(row), samples.getInputs(row) + getNumInputs(), context.shuffled.getInputs(i));
+			copy(samples.getOutputs(row), samples.getOutputs(row) + getNumOutputs(), context.shuffled.getOutputs(i));
+		}
+	}
+	const Dataset &data = config.shuffle ? context.shuffled : samples;
+
+	float err = 0.f;
+	if (config.hogwild)
+		err = hogwildEpoch(data, context);
+	else if (batchSize > 1 || !context.optimizer->isPlainSgd())
+	{
+		// Optimizers with state need the gradient itself, even for single samples
+		for (size_t i = 0; i < data.size(); i += batchSize)
+			err += backPropagateBatch(data, i, min(data.size(), i + batchSize), context);
+	}
+	else
+		for (size_t i = 0; i < data.size(); ++i)
+			err += backPropagateStep(data.getInputs(i), data.getOutputs(i), context.learningRate, context.biasRate, context.workers[0]);
+	return err;
+}
+
+/*
+ * Summed loss over data, matching the error training reports
+ */
+float NeuralNet::calcError(const Dataset &data) const
+{
+	assert(data.getNumInputs() == getNumInputs() && data.getNumOutputs() == getNumOutputs());
+	const bool softmax = layers.back().getActivation() == Activation::Softmax;
+	FloatVec outputs = calcProbBatch(data);
+	const float *correctVals = data.getOutputs();
+
+	float error = 0.f;
+	for (size_t i = 0; i < outputs.size(); ++i)
+	{
+		if (softmax)
+			error -= correctVals[i] * log(max(outputs[i], 1e-30f));
+		else
+			error += (outputs[i] - correctVals[i]) * (outputs[i] - correctVals[i]) / 2.f;
+	}
+	return error;
+}
+
+/*
+ * Repeats runEpoch until the error is low enough or stops improving,
+ * or a limit from config is reached, reporting progress to the observer
+ * along the way. With validation data, restores the best scoring weights
+ */
+BackPropResult NeuralNet::trainEpochs(const TrainConfig &config, const function<float(size_t &numSamples)> &runEpoch)
 {
 	const float minDiff = 0.000001f;
-	const float avErrWeight = 1.f - 5.f * maxError;
+	const float avErrWeight = 1.f - 5.f * config.maxError;
 	float avErr = 0.f;
 	long epoch = 0;
 
-	const auto &adjVals = resolveConflicts(vals);
+	// The clock is only read when someone is listening or there is a time limit
+	using Clock = chrono::steady_clock;
+	const bool timed = config.observer || config.maxSeconds > 0;
+	const long observeInterval = max<long>(1, config.observeInterval);
+	Clock::time_point startTime, lastReport;
+	size_t samplesSinceReport = 0;
+	if (timed)
+		startTime = lastReport = Clock::now();
+
+	const long validationInterval = max<long>(1, config.validationInterval);
+	float bestValidation = numeric_limits<float>::infinity(), bestError = 0.f;
+	long bestEpoch = 0, sinceBest = 0;
+	vector<Layer> bestLayers;
 
 	while (1)
 	{
 		++epoch;
 
-		float err = 0.f;
-		for (auto &i : adjVals)
-			err += backPropagateStep(i, learningRate);
+		size_t numSamples = 0;
+		float err = runEpoch(numSamples);
+		samplesSinceReport += numSamples;
 
-		if (debug && epoch % 1024 == 0)
-			cout << "Error: " << err << endl;
+		Clock::time_point now;
+		if (timed)
+			now = Clock::now();
+
+		if (config.observer && epoch % observeInterval == 0)
+		{
+			double sinceReport = chrono::duration<double>(now - lastReport).count();
+			EpochStats stats;
+			stats.epoch = epoch;
+			stats.loss = err;
+			stats.wallTime = chrono::duration<double>(now - startTime).count();
+			stats.samplesPerSec = sinceReport > 0 ? samplesSinceReport / sinceReport : 0;
+			stats.learningRate = config.learningRate;
+			config.observer(stats);
+			lastReport = now;
+			samplesSinceReport = 0;
+		}
 
-		if (err < maxError || abs(avErr - err) < minDiff)
-			return {epoch, err};
+		bool stop = err < config.maxError || abs(avErr - err) < minDiff;
+		if (config.validation && epoch % validationInterval == 0)
+		{
+			float validationErr = calcError(*config.validation);
+			if (validationErr < bestValidation)
+			{
+				bestValidation = validationErr;
+				bestError = err;
+				bestEpoch = epoch;
+				bestLayers = layers;
+				sinceBest = 0;
+			}
+			else if (config.patience > 0 && ++sinceBest >= config.patience)
+				stop = true;
+		}
+		if (config.maxEpochs > 0 && epoch >= config.maxEpochs)
+			stop = true;
+		if (config.maxSeconds > 0 && chrono::duration<double>(now - startTime).count() >= config.maxSeconds)
+			stop = true;
+
+		if (stop)
+		{
+			// Scores the final weights too when they fell between checks
+			if (config.validation && epoch % validationInterval != 0)
+			{
+				float validationErr = calcError(*config.validation);
+				if (validationErr < bestValidation)
+				{
+					bestValidation = validationErr;
+					bestError = err;
+					bestEpoch = epoch;
+				}
+			}
+			if (bestEpoch == 0)
+				return {epoch, err, 0.f, epoch};
+			if (bestEpoch != epoch)
+				layers = move(bestLayers);
+			return {epoch, bestError, bestValidation, bestEpoch};
+		}
 
 		avErr = avErrWeight * avErr + (1 - avErrWeight) * err;
 	}
@@ -243,4 +899,80 @@ FloatVec NeuralNet::calcProb(const FloatVec &inputVals) const
 	return vals;
 }
 
-}
\ No newline at end of file
+Workspace::Workspace(const NeuralNet &net, size_t maxRows) : maxRows(max<size_t>(1, maxRows)),
+maxWidth(net.getMaxWidth()), bufA(this->maxRows * maxWidth), bufB(this->maxRows * maxWidth) { }
+
+size_t Workspace::getMaxRows() const
+{
+	return maxRows;
+}
+
+size_t NeuralNet::getMaxWidth() const
+{
+	size_t maxWidth = 0;
+	for (auto &i : layers)
+		maxWidth = max(maxWidth, i.numNodes());
+	return maxWidth;
+}
+
+/*
+ * Takes numRows input rows stored back to back and
+ * returns the output rows stored the same way
+ */
+FloatVec NeuralNet::calcProbBatch(const FloatVec &inputRows, size_t numRows) const
+{
+	assert(inputRows.size() == numRows * getNumInputs());
+	Workspace workspace(*this, numRows);
+	FloatVec outputRows(numRows * getNumOutputs());
+	calcProbBatch(inputRows.data(), numRows, outputRows.data(), workspace);
+	return outputRows;
+}
+
+/*
+ * Returns the output rows for every row of data, stored back to back
+ */
+FloatVec NeuralNet::calcProbBatch(const Dataset &data) const
+{
+	assert(data.getNumInputs() == getNumInputs());
+	Workspace workspace(*this, min<size_t>(data.size(), 256));
+	FloatVec outputRows(data.size() * getNumOutputs());
+	calcProbBatch(data.getInputs(), data.size(), outputRows.data(), workspace);
+	return outputRows;
+}
+
+/*
+ * Writes getNumOutputs() values to outputVals without allocating
+ */
+void NeuralNet::calcProb(const float *inputVals, float *outputVals, Workspace &workspace) const
+{
+	calcProbBatch(inputVals, 1, outputVals, workspace);
+}
+
+/*
+ * Same as calcProbBatch above, but writes into outputRows and keeps
+ * intermediate layers in the workspace, so nothing is allocated
+ */
+void NeuralNet::calcProbBatch(const float *inputRows, size_t numRows, float *outputRows, Workspace &workspace) const
+{
+	assert(workspace.maxWidth >= getMaxWidth());
+	const size_t numInputs = getNumInputs(), numOutputs = getNumOutputs();
+	for (size_t start = 0; start < numRows; start += workspace.maxRows)
+	{
+		size_t chunkRows = min(workspace.maxRows, numRows - start);
+
+		// Alternate between two buffers so each layer is a single matrix product
+		// The last layer writes straight into the caller's output
+		const float *prev = inputRows + start * numInputs;
+		float *next = workspace.bufA.data();
+		for (size_t layerId = 0; layerId < layers.size(); ++layerId)
+		{
+			if (layerId + 1 == layers.size())
+				next = outputRows + start * numOutputs;
+			calcLayerOutputsBatch(layers[layerId], prev, chunkRows, next);
+			prev = next;
+			next = next == workspace.bufA.data() ? workspace.bufB.data() : workspace.bufA.data();
+		}
+	}
+}
+
+}
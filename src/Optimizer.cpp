@@ -0,0 +1,126 @@
+#include <cassert>
+#include <cmath>
+#include "Optimizer.hpp"
+#include "Kernels.hpp"
+
+using namespace std;
+
+namespace sciod
+{
+
+static vector<size_t> layerTopology(const vector<Layer> &layers)
+{
+	vector<size_t> topology;
+	if (!layers.empty())
+		topology.push_back(layers[0].numPrevNodes());
+	for (auto &layer : layers)
+		topology.push_back(layer.numNodes());
+	return topology;
+}
+
+Optimizer::Optimizer(const OptimizerConfig &config, const vector<Layer> &layers) :
+config(config), topology(layerTopology(layers))
+{
+	size_t numParams = 0;
+	for (auto &layer : layers)
+		numParams += layer.numPrevNodes() * layer.numNodes() + layer.numNodes();
+
+	if (config.type != OptimizerType::Sgd)
+		first.assign(numParams, 0.f);
+	if (config.type == OptimizerType::Adam)
+		second.assign(numParams, 0.f);
+}
+
+bool Optimizer::matches(const OptimizerConfig &otherConfig, const vector<Layer> &layers) const
+{
+	return config.type == otherConfig.type && config.biasScale == otherConfig.biasScale &&
+		config.momentum == otherConfig.momentum && config.rmsDecay == otherConfig.rmsDecay &&
+		config.beta1 == otherConfig.beta1 && config.beta2 == otherConfig.beta2 &&
+		config.epsilon == otherConfig.epsilon && topology == layerTopology(layers);
+}
+
+bool Optimizer::isPlainSgd() const
+{
+	return config.type == OptimizerType::Sgd;
+}
+
+float Optimizer::getBiasScale() const
+{
+	return config.biasScale;
+}
+
+void Optimizer::apply(vector<Layer> &layers, const vector<LayerGradient> &grads, float gradScale, float learningRate)
+{
+	assert(grads.size() == layers.size());
+	++step;
+	if (config.type == OptimizerType::Adam)
+	{
+		firstCorrection = 1.f / (1.f - pow(config.beta1, float(step)));
+		secondCorrection = 1.f / (1.f - pow(config.beta2, float(step)));
+	}
+
+	size_t offset = 0;
+	for (size_t layerId = 0; layerId < layers.size(); ++layerId)
+	{
+		Layer &layer = layers[layerId];
+		const LayerGradient &grad = grads[layerId];
+		if (config.type == OptimizerType::Sgd)
+		{
+			layer.applyGradient(grad, learningRate * gradScale, learningRate * config.biasScale * gradScale);
+			continue;
+		}
+		update(layer.getWeights(), grad.weights.data(), offset, grad.weights.size(), gradScale, learningRate);
+		offset += grad.weights.size();
+		update(layer.getBiases(), grad.biases.data(), offset, grad.biases.size(), gradScale, learningRate * config.biasScale);
+		offset += grad.biases.size();
+	}
+}
+
+void Optimizer::update(float *params, const float *grads, size_t offset, size_t n, float gradScale, float rate)
+{
+	float *m = first.data() + offset;
+	switch (config.type)
+	{
+		case OptimizerType::Sgd:
+			axpy(-rate * gradScale, grads, params, n);
+			break;
+		case OptimizerType::Momentum:
+			for (size_t i = 0; i < n; ++i)
+			{
+				m[i] = config.momentum * m[i] + gradScale * grads[i];
+				params[i] -= rate * m[i];
+			}
+			break;
+		case OptimizerType::Nesterov:
+			// Steps from the point the velocity is about to carry the weights to
+			for (size_t i = 0; i < n; ++i)
+			{
+				float g = gradScale * grads[i];
+				m[i] = config.momentum * m[i] + g;
+				params[i] -= rate * (g + config.momentum * m[i]);
+			}
+			break;
+		case OptimizerType::RMSProp:
+			for (size_t i = 0; i < n; ++i)
+			{
+				float g = gradScale * grads[i];
+				m[i] = config.rmsDecay * m[i] + (1.f - config.rmsDecay) * g * g;
+				params[i] -= rate * g / (sqrt(m[i]) + config.epsilon);
+			}
+			break;
+		case OptimizerType::Adam:
+		{
+			float *v = second.data() + offset;
+			for (size_t i = 0; i < n; ++i)
+			{
+				float g = gradScale * grads[i];
+				m[i] = config.beta1 * m[i] + (1.f - config.beta1) * g;
+				v[i] = config.beta2 * v[i] + (1.f - config.beta2) * g * g;
+				params[i] -= rate * m[i] * firstCorrection / (sqrt(v[i] * secondCorrection) + config.epsilon);
+			}
+			break;
+		}
+	}
+}
+
+}
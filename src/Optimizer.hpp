@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include "sciod/NeuralNet.hpp"
+
+namespace sciod
+{
+	/*
+	 * Applies gradients to a network's layers with the rule chosen by an
+	 * OptimizerConfig, keeping whatever per parameter state it needs
+	 *
+	 * State is held in one contiguous buffer per moment, laid out like the
+	 * parameters themselves: each layer's weights followed by its biases,
+	 * one layer after another
+	 */
+	class Optimizer
+	{
+	public:
+		Optimizer(const OptimizerConfig &config, const std::vector<Layer> &layers);
+
+		// Whether the state was built for this config and these layer sizes
+		bool matches(const OptimizerConfig &otherConfig, const std::vector<Layer> &layers) const;
+
+		// Plain SGD keeps no state and can be fused into the backward pass
+		bool isPlainSgd() const;
+		float getBiasScale() const;
+
+		// Updates layers with grads multiplied by gradScale (ie. 1 / batch size)
+		void apply(std::vector<Layer> &layers, const std::vector<LayerGradient> &grads,
+				   float gradScale, float learningRate);
+
+	private:
+		void update(float *params, const float *grads, size_t offset, size_t n, float gradScale, float rate);
+
+		OptimizerConfig config;
+		std::vector<size_t> topology;
+		long step = 0;
+
+		// Moment decay corrections for Adam, refreshed every step
+		float firstCorrection = 1.f, secondCorrection = 1.f;
+
+		// Velocity (Momentum, Nesterov), mean square (RMSProp) or first moment (Adam)
+		AlignedFloatVec first;
+
+		// Adam's second moment
+		AlignedFloatVec second;
+	};
+}
@@ -0,0 +1,219 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include "sciod/QuantizedNet.hpp"
+#include "Kernels.hpp"
+
+using namespace std;
+
+namespace sciod
+{
+
+static const size_t rowAlign = 64;
+
+/*
+ * Replaces the contents with net's weights in 8 bits, with the range
+ * of every layer's inputs measured by running calibration through net
+ * Returns false and leaves the net untouched if calibration is empty
+ * or does not match the net's inputs
+ */
+bool QuantizedNet::quantize(const NeuralNet &net, const Dataset &calibration)
+{
+	if (net.getNumLayers() == 0 || calibration.empty() || calibration.getNumInputs() != net.getNumInputs())
+		return false;
+
+	// The range always includes 0, so that zero maps to an exact value
+	vector<float> minVals(net.getNumLayers(), 0.f), maxVals(net.getNumLayers(), 0.f);
+	for (size_t i = 0; i < calibration.size(); ++i)
+	{
+		const float *inputs = calibration.getInputs(i);
+		FloatVec2D nodeProb = net.calcProbFull(FloatVec(inputs, inputs + calibration.getNumInputs()));
+		for (size_t layerId = 0; layerId < net.getNumLayers(); ++layerId)
+		{
+			for (float val : nodeProb[layerId])
+			{
+				minVals[layerId] = min(minVals[layerId], val);
+				maxVals[layerId] = max(maxVals[layerId], val);
+			}
+		}
+	}
+
+	vector<QuantizedLayer> newLayers(net.getNumLayers());
+	for (size_t layerId = 0; layerId < net.getNumLayers(); ++layerId)
+	{
+		const Layer &row = net.getLayer(layerId);
+		QuantizedLayer &layer = newLayers[layerId];
+		layer.prevSize = row.numPrevNodes();
+		layer.size = row.numNodes();
+		layer.stride = (layer.prevSize + rowAlign - 1) / rowAlign * rowAlign;
+		layer.activation = row.getActivation();
+
+		float range = maxVals[layerId] - minVals[layerId];
+		layer.inScale = range > 0.f ? range / 255.f : 1.f;
+		layer.inZero = min(255, max(0, int32_t(lrintf(-minVals[layerId] / layer.inScale))));
+
+		layer.weights.assign(layer.size * layer.stride, 0);
+		layer.weightScales.resize(layer.size);
+		layer.rowSums.resize(layer.size);
+		layer.biases.assign(row.getBiases(), row.getBiases() + layer.size);
+		for (size_t dest = 0; dest < layer.size; ++dest)
+		{
+			const float *weights = row.getRow(dest);
+			float maxAbs = 0.f;
+			for (size_t src = 0; src < layer.prevSize; ++src)
+				maxAbs = max(maxAbs, fabs(weights[src]));
+			float scale = maxAbs > 0.f ? maxAbs / 127.f : 1.f;
+
+			int8_t *quantized = layer.weights.data() + dest * layer.stride;
+			int32_t sum = 0;
+			for (size_t src = 0; src < layer.prevSize; ++src)
+			{
+				quantized[src] = int8_t(min(127L, max(-127L, lrintf(weights[src] / scale))));
+				sum += quantized[src];
+			}
+			layer.weightScales[dest] = scale;
+			layer.rowSums[dest] = sum;
+		}
+	}
+	layers = move(newLayers);
+	sigmoidMode = net.getSigmoidMode();
+	return true;
+}
+
+size_t QuantizedNet::getNumInputs() const
+{
+	return layers.empty() ? 0 : layers[0].prevSize;
+}
+
+size_t QuantizedNet::getNumOutputs() const
+{
+	return layers.empty() ? 0 : layers.back().size;
+}
+
+size_t QuantizedNet::getNumLayers() const
+{
+	return layers.size();
+}
+
+/*
+ * Writes numRows rows of layer.stride bytes, zero padded
+ */
+void QuantizedNet::quantizeInputs(const QuantizedLayer &layer, const float *vals, size_t numRows, uint8_t *out) const
+{
+	const float invScale = 1.f / layer.inScale;
+	for (size_t r = 0; r < numRows; ++r)
+	{
+		const float *rowVals = vals + r * layer.prevSize;
+		uint8_t *rowOut = out + r * layer.stride;
+		for (size_t i = 0; i < layer.prevSize; ++i)
+		{
+			// Clamped before rounding so the conversion cannot overflow
+			float val = min(max(rowVals[i] * invScale + layer.inZero, 0.f), 255.f);
+			rowOut[i] = uint8_t(val + 0.5f);
+		}
+		fill(rowOut + layer.prevSize, rowOut + layer.stride, 0);
+	}
+}
+
+FloatVec QuantizedNet::calcProb(const FloatVec &inputVals) const
+{
+	assert(inputVals.size() == getNumInputs());
+	FloatVec outputVals(getNumOutputs());
+	calcProbBatch(inputVals.data(), 1, outputVals.data());
+	return outputVals;
+}
+
+/*
+ * Same layout as NeuralNet::calcProbBatch: rows stored back to back
+ */
+void QuantizedNet::calcProbBatch(const float *inputRows, size_t numRows, float *outputRows) const
+{
+	size_t maxStride = 0, maxWidth = 0;
+	for (auto &layer : layers)
+	{
+		maxStride = max(maxStride, layer.stride);
+		maxWidth = max(maxWidth, layer.size);
+	}
+
+	// Rows are quantized a tile at a time to keep the buffers small
+	const size_t rowTile = min<size_t>(numRows, 256);
+	ByteVec quantized(rowTile * maxStride);
+	vector<int32_t> sums(rowTile * maxWidth);
+	AlignedFloatVec bufA(rowTile * maxWidth), bufB(rowTile * maxWidth);
+
+	for (size_t start = 0; start < numRows; start += rowTile)
+	{
+		size_t tileRows = min(rowTile, numRows - start);
+		const float *prev = inputRows + start * getNumInputs();
+		float *next = bufA.data();
+		for (size_t layerId = 0; layerId < layers.size(); ++layerId)
+		{
+			const QuantizedLayer &layer = layers[layerId];
+			if (layerId + 1 == layers.size())
+				next = outputRows + start * getNumOutputs();
+
+			quantizeInputs(layer, prev, tileRows, quantized.data());
+			denseForwardU8S8(quantized.data(), tileRows, layer.stride, layer.weights.data(), layer.size, sums.data());
+			for (size_t r = 0; r < tileRows; ++r)
+			{
+				const int32_t *rowSums = sums.data() + r * layer.size;
+				float *rowOut = next + r * layer.size;
+				for (size_t dest = 0; dest < layer.size; ++dest)
+					rowOut[dest] = layer.inScale * layer.weightScales[dest] *
+						float(rowSums[dest] - layer.inZero * layer.rowSums[dest]) + layer.biases[dest];
+			}
+			activate(layer.activation, next, tileRows, layer.size, sigmoidMode);
+
+			prev = next;
+			next = next == bufA.data() ? bufB.data() : bufA.data();
+		}
+	}
+}
+
+static size_t predictedClass(const float *vals, size_t n)
+{
+	if (n == 1)
+		return vals[0] > 0.5f;
+	return max_element(vals, vals + n) - vals;
+}
+
+/*
+ * Runs data through both nets and measures how far apart they are
+ */
+QuantizationReport QuantizedNet::compare(const NeuralNet &net, const Dataset &data) const
+{
+	assert(net.getNumInputs() == getNumInputs() && net.getNumOutputs() == getNumOutputs());
+	assert(data.getNumInputs() == getNumInputs() && data.getNumOutputs() == getNumOutputs());
+
+	QuantizationReport report;
+	if (data.empty())
+		return report;
+
+	const size_t numOutputs = getNumOutputs();
+	FloatVec expected = net.calcProbBatch(data);
+	FloatVec actual(data.size() * numOutputs);
+	calcProbBatch(data.getInputs(), data.size(), actual.data());
+
+	double errorSum = 0.0;
+	size_t floatCorrect = 0, quantizedCorrect = 0;
+	for (size_t r = 0; r < data.size(); ++r)
+	{
+		const float *floatOut = expected.data() + r * numOutputs;
+		const float *quantizedOut = actual.data() + r * numOutputs;
+		for (size_t i = 0; i < numOutputs; ++i)
+		{
+			float error = fabs(floatOut[i] - quantizedOut[i]);
+			report.maxAbsError = max(report.maxAbsError, error);
+			errorSum += error;
+		}
+		size_t correctClass = predictedClass(data.getOutputs(r), numOutputs);
+		floatCorrect += predictedClass(floatOut, numOutputs) == correctClass;
+		quantizedCorrect += predictedClass(quantizedOut, numOutputs) == correctClass;
+	}
+	report.meanAbsError = errorSum / (data.size() * numOutputs);
+	report.floatAccuracy = float(floatCorrect) / data.size();
+	report.quantizedAccuracy = float(quantizedCorrect) / data.size();
+	return report;
+}
+
+}
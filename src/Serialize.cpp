@@ -0,0 +1,358 @@
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include "sciod/NeuralNet.hpp"
+#include "sciod/HalfNet.hpp"
+#include "Kernels.hpp"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace sciod
+{
+
+/*
+ * Binary model format, in host byte order (checked when loading):
+ *
+ *   FileHeader         64 bytes
+ *   LayerRecord        32 bytes per layer
+ *   weight and bias blocks, each starting on a 64 byte boundary
+ *
+ * Block offsets are from the start of the file. Aligned blocks let a
+ * memory mapped file be used directly as the weights of a layer
+ *
+ * Weights are stored as WeightType: F32, F16 or BF16. Biases are
+ * always 32 bit floats
+ */
+namespace
+{
+	const char fileMagic[8] = {'S', 'C', 'I', 'O', 'D', 'N', 'N', '\0'};
+	const uint32_t fileVersion = 1;
+	const uint32_t byteOrderMark = 0x01020304;
+	const size_t blockAlign = 64;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder;
+		uint32_t weightType;
+		uint32_t numLayers;
+		uint32_t sigmoidMode;
+		uint32_t reserved[9];
+	};
+
+	struct LayerRecord
+	{
+		uint32_t prevSize, size, activation, reserved;
+		uint64_t weightOffset, biasOffset;
+	};
+
+	static_assert(sizeof(FileHeader) == 64, "FileHeader must stay 64 bytes");
+	static_assert(sizeof(LayerRecord) == 32, "LayerRecord must stay 32 bytes");
+
+	// What save needs from either kind of net for each layer
+	struct LayerBlocks
+	{
+		uint32_t prevSize, size;
+		Activation activation;
+		const void *weights;
+		const float *biases;
+	};
+}
+
+static size_t weightSize(WeightType type)
+{
+	return type == WeightType::F32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+static size_t alignUp(size_t val)
+{
+	return (val + blockAlign - 1) / blockAlign * blockAlign;
+}
+
+/*
+ * Checks the header and layer table of a whole file image
+ * Returns false on anything malformed or out of bounds
+ */
+static bool parseModel(const char *data, size_t length, FileHeader &header, vector<LayerRecord> &records)
+{
+	if (length < sizeof(FileHeader))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 || header.version != fileVersion ||
+		header.byteOrder != byteOrderMark || header.weightType > uint32_t(WeightType::BF16) ||
+		header.sigmoidMode > uint32_t(SigmoidMode::Fast) || header.numLayers == 0)
+		return false;
+
+	if (length < sizeof(FileHeader) + uint64_t(header.numLayers) * sizeof(LayerRecord))
+		return false;
+	records.resize(header.numLayers);
+	memcpy(records.data(), data + sizeof(FileHeader), header.numLayers * sizeof(LayerRecord));
+
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const LayerRecord &rec = records[i];
+		uint64_t weightBytes = uint64_t(rec.prevSize) * rec.size * weightSize(WeightType(header.weightType));
+		uint64_t biasBytes = uint64_t(rec.size) * sizeof(float);
+		if (rec.prevSize == 0 || rec.size == 0 || rec.activation > uint32_t(Activation::Softmax))
+			return false;
+		if (Activation(rec.activation) == Activation::Softmax && i + 1 != records.size())
+			return false;
+		if (i > 0 && rec.prevSize != records[i - 1].size)
+			return false;
+		if (rec.weightOffset % blockAlign != 0 || rec.biasOffset % blockAlign != 0)
+			return false;
+		if (rec.weightOffset > length || weightBytes > length - rec.weightOffset ||
+			rec.biasOffset > length || biasBytes > length - rec.biasOffset)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Writes the header, layer table and blocks for layers to filename
+ * Returns false if the file could not be written
+ */
+static bool writeModel(const string &filename, WeightType type, SigmoidMode mode, const vector<LayerBlocks> &layers)
+{
+	if (layers.empty())
+		return false;
+
+	FileHeader header = {};
+	memcpy(header.magic, fileMagic, sizeof(fileMagic));
+	header.version = fileVersion;
+	header.byteOrder = byteOrderMark;
+	header.weightType = uint32_t(type);
+	header.numLayers = layers.size();
+	header.sigmoidMode = uint32_t(mode);
+
+	vector<LayerRecord> records(layers.size());
+	size_t offset = alignUp(sizeof(FileHeader) + records.size() * sizeof(LayerRecord));
+	for (size_t i = 0; i < layers.size(); ++i)
+	{
+		const LayerBlocks &row = layers[i];
+		LayerRecord &rec = records[i];
+		rec = LayerRecord();
+		rec.prevSize = row.prevSize;
+		rec.size = row.size;
+		rec.activation = uint32_t(row.activation);
+		rec.weightOffset = offset;
+		offset = alignUp(offset + uint64_t(row.prevSize) * row.size * weightSize(type));
+		rec.biasOffset = offset;
+		offset = alignUp(offset + uint64_t(row.size) * sizeof(float));
+	}
+
+	ofstream file(filename, ios::binary | ios::trunc);
+	if (!file)
+		return false;
+
+	size_t written = 0;
+	auto write = [&](const void *data, size_t bytes)
+	{
+		file.write(static_cast<const char *>(data), bytes);
+		written += bytes;
+	};
+	auto padTo = [&](size_t target)
+	{
+		static const char zeros[blockAlign] = {};
+		assert(target >= written && target - written < blockAlign);
+		write(zeros, target - written);
+	};
+
+	write(&header, sizeof(header));
+	write(records.data(), records.size() * sizeof(LayerRecord));
+	for (size_t i = 0; i < layers.size(); ++i)
+	{
+		const LayerBlocks &row = layers[i];
+		padTo(records[i].weightOffset);
+		write(row.weights, uint64_t(row.prevSize) * row.size * weightSize(type));
+		padTo(records[i].biasOffset);
+		write(row.biases, uint64_t(row.size) * sizeof(float));
+	}
+	padTo(offset);
+	return bool(file);
+}
+
+/*
+ * Reads all of filename into data
+ */
+static bool readFile(const string &filename, vector<char> &data)
+{
+	ifstream file(filename, ios::binary | ios::ate);
+	if (!file)
+		return false;
+	streamoff length = file.tellg();
+	if (length <= 0)
+		return false;
+	data.resize(length);
+	file.seekg(0);
+	return bool(file.read(data.data(), length));
+}
+
+/*
+ * Writes the topology, activations and weights to filename
+ * Weights are rounded to type; load widens them back to float
+ * Returns false if the file could not be written
+ */
+bool NeuralNet::save(const string &filename, WeightType type) const
+{
+	vector<LayerBlocks> blocks;
+	vector<vector<uint16_t>> halfWeights;
+	for (auto &row : layers)
+	{
+		const void *weights = row.getWeights();
+		if (type != WeightType::F32)
+		{
+			halfWeights.emplace_back(row.numPrevNodes() * row.numNodes());
+			for (size_t i = 0; i < halfWeights.back().size(); ++i)
+				halfWeights.back()[i] = floatToHalf(row.getWeights()[i], type);
+			weights = halfWeights.back().data();
+		}
+		blocks.push_back({uint32_t(row.numPrevNodes()), uint32_t(row.numNodes()), row.getActivation(),
+						weights, row.getBiases()});
+	}
+	return writeModel(filename, type, sigmoidMode, blocks);
+}
+
+/*
+ * Reads a model written by save, copying the weights into the net
+ * Returns false and leaves the net untouched if the file is invalid
+ */
+bool NeuralNet::load(const string &filename)
+{
+	vector<char> data;
+	if (!readFile(filename, data))
+		return false;
+
+	FileHeader header;
+	vector<LayerRecord> records;
+	if (!parseModel(data.data(), data.size(), header, records))
+		return false;
+
+	vector<Layer> newLayers;
+	for (auto &rec : records)
+	{
+		newLayers.emplace_back(rec.prevSize, rec.size, Activation(rec.activation));
+		Layer &row = newLayers.back();
+		const size_t numWeights = size_t(rec.prevSize) * rec.size;
+		if (WeightType(header.weightType) == WeightType::F32)
+			memcpy(row.getWeights(), data.data() + rec.weightOffset, numWeights * sizeof(float));
+		else
+		{
+			vector<uint16_t> halfWeights(numWeights);
+			memcpy(halfWeights.data(), data.data() + rec.weightOffset, numWeights * sizeof(uint16_t));
+			halfToFloat(halfWeights.data(), row.getWeights(), numWeights, WeightType(header.weightType));
+		}
+		memcpy(row.getBiases(), data.data() + rec.biasOffset, rec.size * sizeof(float));
+	}
+	layers = move(newLayers);
+	sigmoidMode = SigmoidMode(header.sigmoidMode);
+	resetOptimizer();
+	return true;
+}
+
+/*
+ * Maps a model written by save into memory and uses its weights in place
+ * The mapping is private: training the net afterwards copies only the
+ * touched pages and never modifies the file
+ * 16 bit weights cannot be used in place, so those files are loaded
+ * Returns false and leaves the net untouched if the file is invalid
+ */
+bool NeuralNet::loadMapped(const string &filename)
+{
+#ifdef _WIN32
+	return load(filename);
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size <= 0)
+	{
+		close(fd);
+		return false;
+	}
+	size_t length = info.st_size;
+	void *addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return false;
+
+	// Unmapped once the last layer referring to it is gone
+	shared_ptr<void> mapping(addr, [length](void *ptr) { munmap(ptr, length); });
+	char *data = static_cast<char *>(addr);
+
+	FileHeader header;
+	vector<LayerRecord> records;
+	if (!parseModel(data, length, header, records))
+		return false;
+	if (WeightType(header.weightType) != WeightType::F32)
+		return load(filename);
+
+	vector<Layer> newLayers;
+	for (auto &rec : records)
+		newLayers.emplace_back(rec.prevSize, rec.size, Activation(rec.activation),
+							reinterpret_cast<float *>(data + rec.weightOffset),
+							reinterpret_cast<float *>(data + rec.biasOffset), mapping);
+	layers = move(newLayers);
+	sigmoidMode = SigmoidMode(header.sigmoidMode);
+	resetOptimizer();
+	return true;
+#endif
+}
+
+bool HalfNet::save(const string &filename) const
+{
+	vector<LayerBlocks> blocks;
+	for (auto &layer : layers)
+		blocks.push_back({uint32_t(layer.prevSize), uint32_t(layer.size), layer.activation,
+						layer.weights.data(), layer.biases.data()});
+	return writeModel(filename, weightType, sigmoidMode, blocks);
+}
+
+/*
+ * Reads a model saved with F16 or BF16 weights, keeping them in 16 bits
+ * Returns false and leaves the net untouched if the file is invalid or
+ * stores 32 bit weights
+ */
+bool HalfNet::load(const string &filename)
+{
+	vector<char> data;
+	if (!readFile(filename, data))
+		return false;
+
+	FileHeader header;
+	vector<LayerRecord> records;
+	if (!parseModel(data.data(), data.size(), header, records) || WeightType(header.weightType) == WeightType::F32)
+		return false;
+
+	vector<HalfLayer> newLayers(records.size());
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const LayerRecord &rec = records[i];
+		HalfLayer &layer = newLayers[i];
+		layer.prevSize = rec.prevSize;
+		layer.size = rec.size;
+		layer.activation = Activation(rec.activation);
+		layer.weights.resize(size_t(rec.prevSize) * rec.size);
+		memcpy(layer.weights.data(), data.data() + rec.weightOffset, layer.weights.size() * sizeof(uint16_t));
+		layer.biases.resize(rec.size);
+		memcpy(layer.biases.data(), data.data() + rec.biasOffset, rec.size * sizeof(float));
+	}
+	layers = move(newLayers);
+	weightType = WeightType(header.weightType);
+	sigmoidMode = SigmoidMode(header.sigmoidMode);
+	return true;
+}
+
+}
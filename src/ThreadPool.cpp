@@ -0,0 +1,74 @@
+#include <cassert>
+#include "ThreadPool.hpp"
+
+using namespace std;
+
+namespace sciod
+{
+
+ThreadPool::ThreadPool(size_t numThreads) : task(nullptr), generation(0), numRunning(0), stopping(false)
+{
+	assert(numThreads > 0);
+	for (size_t i = 1; i < numThreads; ++i)
+		threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	startCond.notify_all();
+	for (auto &i : threads)
+		i.join();
+}
+
+size_t ThreadPool::numWorkers() const
+{
+	return threads.size() + 1;
+}
+
+void ThreadPool::run(const function<void(size_t)> &newTask)
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		task = &newTask;
+		numRunning = threads.size();
+		++generation;
+	}
+	startCond.notify_all();
+
+	newTask(0);
+
+	unique_lock<std::mutex> lock(mutex);
+	doneCond.wait(lock, [this] { return numRunning == 0; });
+	task = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t workerId)
+{
+	size_t seenGeneration = 0;
+	while (1)
+	{
+		const function<void(size_t)> *current;
+		{
+			unique_lock<std::mutex> lock(mutex);
+			startCond.wait(lock, [&] { return stopping || generation != seenGeneration; });
+			if (stopping)
+				return;
+			seenGeneration = generation;
+			current = task;
+		}
+
+		(*current)(workerId);
+
+		{
+			lock_guard<std::mutex> lock(mutex);
+			--numRunning;
+		}
+		doneCond.notify_one();
+	}
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace sciod
+{
+	/*
+	 * Fixed set of worker threads running fork-join tasks
+	 * The calling thread takes part as worker 0
+	 */
+	class ThreadPool
+	{
+	public:
+		ThreadPool(size_t numThreads);
+		~ThreadPool();
+		size_t numWorkers() const;
+
+		// Runs task(workerId) once on every worker and waits for all of them
+		void run(const std::function<void(size_t)> &task);
+
+	private:
+		void workerLoop(size_t workerId);
+
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable startCond, doneCond;
+		const std::function<void(size_t)> *task;
+		size_t generation, numRunning;
+		bool stopping;
+	};
+}
@@ -0,0 +1,288 @@
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <future>
+#include <type_traits>
+#include "catch.hpp"
+#include "sciod/NeuralNet.hpp"
+#include "sciod/QuantizedNet.hpp"
+#include "sciod/HalfNet.hpp"
+#include "sciod/InferenceQueue.hpp"
+
+using namespace std;
+using namespace sciod;
+
+TEST_CASE("Batch matches single", "[batch]")
+{
+	const int numInputs = 7, numHidden = 9, hiddenLayers = 2, numOutputs = 3;
+	const size_t numRows = 13;
+	NeuralNet net(numInputs, numHidden, hiddenLayers, numOutputs);
+	srand(1);
+	net.randomize();
+
+	FloatVec rows;
+	for (size_t i = 0; i < numRows * numInputs; ++i)
+		rows.push_back(float(rand()) / RAND_MAX);
+
+	FloatVec batchOut = net.calcProbBatch(rows, numRows);
+	REQUIRE(batchOut.size() == numRows * numOutputs);
+	for (size_t r = 0; r < numRows; ++r)
+	{
+		FloatVec in(rows.begin() + r * numInputs, rows.begin() + (r + 1) * numInputs);
+		FloatVec out = net.calcProb(in);
+		for (size_t i = 0; i < out.size(); ++i)
+			REQUIRE(fabs(out[i] - batchOut[r * numOutputs + i]) < 1e-5f);
+	}
+}
+
+TEST_CASE("Fast sigmoid accuracy", "[sigmoid]")
+{
+	FloatVec exact, fast;
+	for (float x = -40.f; x <= 40.f; x += 0.01f)
+		exact.push_back(x);
+	fast = exact;
+	squash(exact.data(), exact.size(), SigmoidMode::Exact);
+	squash(fast.data(), fast.size(), SigmoidMode::Fast);
+
+	float maxError = 0.f;
+	for (size_t i = 0; i < exact.size(); ++i)
+		maxError = max(maxError, fabs(exact[i] - fast[i]));
+	REQUIRE(maxError < 5e-6f);
+}
+
+TEST_CASE("Save and load", "[serialize]")
+{
+	NeuralNet net(3, 6, 2, 2);
+	net.setActivation(0, Activation::Relu);
+	net.setActivation(2, Activation::Softmax);
+	net.setSigmoidMode(SigmoidMode::Fast);
+	srand(6);
+	net.randomize();
+
+	const string filename = "sciod_test_model.bin";
+	REQUIRE(net.save(filename));
+
+	NeuralNet loaded, mapped;
+	REQUIRE(loaded.load(filename));
+	REQUIRE(mapped.loadMapped(filename));
+	remove(filename.c_str());
+
+	REQUIRE(loaded.toString() == net.toString());
+	REQUIRE(mapped.toString() == net.toString());
+	REQUIRE(mapped.getActivation(0) == Activation::Relu);
+	REQUIRE(mapped.getActivation(2) == Activation::Softmax);
+	REQUIRE(mapped.getSigmoidMode() == SigmoidMode::Fast);
+
+	const FloatVec in = {0.2f, -0.4f, 0.9f};
+	REQUIRE(mapped.calcProb(in) == net.calcProb(in));
+
+	NeuralNet missing;
+	REQUIRE_FALSE(missing.load("sciod_missing_model.bin"));
+}
+
+TEST_CASE("Workspace inference", "[workspace]")
+{
+	NeuralNet net(5, 11, 3, 4);
+	srand(7);
+	net.randomize();
+
+	const size_t numRows = 10;
+	FloatVec rows;
+	for (size_t i = 0; i < numRows * 5; ++i)
+		rows.push_back(float(rand()) / RAND_MAX);
+	FloatVec expected = net.calcProbBatch(rows, numRows);
+
+	// Smaller than the batch, so rows are processed in chunks
+	Workspace workspace(net, 3);
+	FloatVec out(numRows * 4);
+	net.calcProbBatch(rows.data(), numRows, out.data(), workspace);
+	REQUIRE(out == expected);
+
+	Workspace single(net);
+	FloatVec singleOut(4);
+	net.calcProb(rows.data() + 5, singleOut.data(), single);
+	for (size_t i = 0; i < 4; ++i)
+		REQUIRE(fabs(singleOut[i] - expected[4 + i]) < 1e-6f);
+}
+
+TEST_CASE("Tapered topology", "[topology]")
+{
+	const vector<size_t> topology = {3, 6, 2, 1};
+	NeuralNet net(topology);
+	REQUIRE(net.getTopology() == topology);
+	REQUIRE(net.getNumLayers() == 3);
+	REQUIRE(net.getMaxWidth() == 6);
+	srand(8);
+	net.randomize();
+
+	FloatVec rows = {0.1f, 0.5f, 0.9f, 1.f, 0.f, 0.3f};
+	FloatVec batchOut = net.calcProbBatch(rows, 2);
+	REQUIRE(fabs(batchOut[1] - net.calcProb({1.f, 0.f, 0.3f})[0]) < 1e-5f);
+
+	// Nodes are named a-l in order, so the last link joins k and l
+	string str = net.toString();
+	REQUIRE(str.find("k - l: ") != string::npos);
+	REQUIRE(str.find("m - ") == string::npos);
+
+	NeuralNet uniform(2, 4, 3, 1);
+	REQUIRE(uniform.getTopology() == vector<size_t>({2, 4, 4, 4, 1}));
+
+	NeuralNet braced = NeuralNet::fromTopology({784, 256, 64, 10});
+	REQUIRE(braced.getTopology() == vector<size_t>({784, 256, 64, 10}));
+	braced.create({5, 3, 2, 4});
+	REQUIRE(braced.getTopology() == vector<size_t>({5, 3, 2, 4}));
+
+	// A topology never turns into a net behind the caller's back
+	static_assert(!is_convertible<vector<size_t>, NeuralNet>::value, "Topology constructor must be explicit");
+}
+
+TEST_CASE("INT8 quantization", "[quantize]")
+{
+	const vector<size_t> topology = {20, 70, 33, 10};
+	NeuralNet net(topology);
+	net.setActivation(0, Activation::Relu);
+	net.setActivation(2, Activation::Softmax);
+	srand(9);
+	net.randomize();
+
+	// Labelled by the float net itself, so only quantization can miss
+	Dataset data(20, 10);
+	FloatVec inputs(20);
+	for (size_t r = 0; r < 200; ++r)
+	{
+		for (auto &i : inputs)
+			i = float(rand()) / RAND_MAX;
+		data.addRow(inputs, net.calcProb(inputs));
+	}
+
+	QuantizedNet quantized;
+	REQUIRE_FALSE(quantized.quantize(net, Dataset(20, 10)));
+	REQUIRE(quantized.quantize(net, data));
+	REQUIRE(quantized.getNumLayers() == 3);
+	REQUIRE(quantized.getNumOutputs() == 10);
+
+	QuantizationReport report = quantized.compare(net, data);
+	REQUIRE(report.floatAccuracy == 1.f);
+	REQUIRE(report.quantizedAccuracy > 0.9f);
+	REQUIRE(report.maxAbsError < 0.05f);
+	REQUIRE(report.meanAbsError < report.maxAbsError);
+
+	FloatVec single = quantized.calcProb(FloatVec(data.getInputs(5), data.getInputs(5) + 20));
+	FloatVec batch(data.size() * 10);
+	quantized.calcProbBatch(data.getInputs(), data.size(), batch.data());
+	for (size_t i = 0; i < 10; ++i)
+		REQUIRE(single[i] == batch[5 * 10 + i]);
+}
+
+TEST_CASE("Half precision weights", "[half]")
+{
+	const vector<size_t> topology = {37, 64, 21, 5};
+	NeuralNet net(topology);
+	net.setActivation(1, Activation::Tanh);
+	srand(10);
+	net.randomize();
+
+	const size_t numRows = 70;
+	FloatVec rows(numRows * 37);
+	for (auto &i : rows)
+		i = float(rand()) / RAND_MAX;
+	FloatVec expected = net.calcProbBatch(rows, numRows);
+
+	for (WeightType type : {WeightType::F16, WeightType::BF16})
+	{
+		// BF16 keeps 8 bits of mantissa, F16 keeps 11
+		const float tolerance = type == WeightType::F16 ? 2e-3f : 2e-2f;
+		HalfNet half(net, type);
+		REQUIRE(half.getWeightType() == type);
+		FloatVec out(numRows * 5);
+		half.calcProbBatch(rows.data(), numRows, out.data());
+		float maxError = 0.f;
+		for (size_t i = 0; i < out.size(); ++i)
+			maxError = max(maxError, fabs(out[i] - expected[i]));
+		REQUIRE(maxError < tolerance);
+
+		const string filename = "sciod_test_half.bin";
+		REQUIRE(half.save(filename));
+		HalfNet loaded;
+		REQUIRE(loaded.load(filename));
+		remove(filename.c_str());
+		FloatVec loadedOut(numRows * 5);
+		loaded.calcProbBatch(rows.data(), numRows, loadedOut.data());
+		REQUIRE(loadedOut == out);
+
+		// A float net reads the same file, widening the weights
+		REQUIRE(net.save(filename, type));
+		NeuralNet widened, mapped;
+		REQUIRE(widened.load(filename));
+		REQUIRE(mapped.loadMapped(filename));
+		REQUIRE_FALSE(loaded.load("sciod_missing_model.bin"));
+		remove(filename.c_str());
+		FloatVec widenedOut = widened.calcProbBatch(rows, numRows);
+		REQUIRE(mapped.calcProbBatch(rows, numRows) == widenedOut);
+		maxError = 0.f;
+		for (size_t i = 0; i < out.size(); ++i)
+			maxError = max(maxError, fabs(widenedOut[i] - out[i]));
+		REQUIRE(maxError < 1e-5f);
+	}
+
+	const string filename = "sciod_test_float.bin";
+	REQUIRE(net.save(filename));
+	HalfNet half;
+	REQUIRE_FALSE(half.load(filename));
+	remove(filename.c_str());
+}
+
+TEST_CASE("Inference queue", "[queue]")
+{
+	NeuralNet net(vector<size_t>{6, 10, 4});
+	srand(8);
+	net.randomize();
+	ModelPtr model = make_shared<Model>(net);
+
+	FloatVec rows;
+	const size_t numRows = 8;
+	for (size_t i = 0; i < numRows * 6; ++i)
+		rows.push_back(float(rand()) / RAND_MAX);
+
+	float maxError = 0.f;
+	auto checkRow = [&](size_t r, const FloatVec &out)
+	{
+		FloatVec expected = net.calcProb(FloatVec(rows.begin() + r * 6, rows.begin() + (r + 1) * 6));
+		for (size_t i = 0; i < expected.size(); ++i)
+			maxError = max(maxError, fabs(expected[i] - out[i]));
+	};
+
+	// A full batch runs at once, long before the wait is up
+	{
+		QueueConfig config;
+		config.maxBatchSize = numRows;
+		config.maxWaitMicros = 10000000;
+		InferenceQueue queue(model, config);
+		vector<future<FloatVec>> results;
+		for (size_t r = 0; r < numRows; ++r)
+			results.push_back(queue.submit(rows.data() + r * 6));
+		for (size_t r = 0; r < numRows; ++r)
+			checkRow(r, results[r].get());
+		REQUIRE(queue.getNumBatches() == 1);
+	}
+
+	// Requests from many threads all complete, in batches of at most 3
+	{
+		QueueConfig config;
+		config.maxBatchSize = 3;
+		config.maxWaitMicros = 100;
+		InferenceQueue queue(model, config);
+		vector<FloatVec> outputs(numRows);
+		vector<thread> callers;
+		for (size_t r = 0; r < numRows; ++r)
+			callers.emplace_back([&, r] { outputs[r] = queue.submit(rows.data() + r * 6).get(); });
+		for (auto &caller : callers)
+			caller.join();
+		for (size_t r = 0; r < numRows; ++r)
+			checkRow(r, outputs[r]);
+		REQUIRE(queue.getNumBatches() >= 3);
+	}
+	REQUIRE(maxError < 1e-5f);
+}
@@ -0,0 +1,580 @@
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include "catch.hpp"
+#include "sciod/NeuralNet.hpp"
+#include "sciod/FixedNet.hpp"
+#include "sciod/Model.hpp"
+
+using namespace std;
+using namespace sciod;
+
+static const vector<FloatVecIO> xorData = {
+	{ {0, 0}, {0} },
+	{ {0, 1}, {1} },
+	{ {1, 0}, {1} },
+	{ {1, 1}, {0} }
+};
+
+// Counts every use of the global operator new, from any thread. All
+// forms are replaced and kept out of line, so the optimizer always pairs
+// a new with the matching delete
+static atomic<size_t> numAllocations(0);
+
+__attribute__((noinline)) static void *countedAlloc(size_t size) noexcept
+{
+	++numAllocations;
+	return malloc(size ? size : 1);
+}
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+	if (void *ptr = countedAlloc(size))
+		return ptr;
+	throw bad_alloc();
+}
+
+__attribute__((noinline)) void *operator new[](size_t size)
+{
+	if (void *ptr = countedAlloc(size))
+		return ptr;
+	throw bad_alloc();
+}
+
+__attribute__((noinline)) void *operator new(size_t size, const nothrow_t &) noexcept
+{
+	return countedAlloc(size);
+}
+
+__attribute__((noinline)) void *operator new[](size_t size, const nothrow_t &) noexcept
+{
+	return countedAlloc(size);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void *ptr) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr, const nothrow_t &) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void *ptr, const nothrow_t &) noexcept
+{
+	free(ptr);
+}
+
+static float totalError(const NeuralNet &net, const vector<FloatVecIO> &data)
+{
+	float error = 0.f;
+	for (auto &vecIO : data)
+	{
+		auto calcOut = net.calcProb(vecIO.in);
+		for (size_t i = 0; i < vecIO.out.size(); ++i)
+			error += (0.5f * pow(calcOut[i] - vecIO.out[i], 2.f));
+	}
+	return error;
+}
+
+TEST_CASE("Mini-batch XOR", "[train][batch]")
+{
+	TrainConfig config;
+	config.maxError = 0.001f;
+	config.learningRate = 4.f;
+	config.batchSize = 2;
+
+	NeuralNet net(2, 5, 1, 1);
+	srand(2);
+	net.randomize();
+	net.backPropagate(xorData, config);
+	REQUIRE(totalError(net, xorData) < config.maxError);
+}
+
+TEST_CASE("Parallel mini-batch is deterministic", "[train][parallel]")
+{
+	TrainConfig config;
+	config.maxError = 0.001f;
+	config.learningRate = 8.f;
+	config.batchSize = 4;
+	config.numThreads = 3;
+
+	NeuralNet netA(2, 5, 1, 1), netB(2, 5, 1, 1);
+	srand(3);
+	netA.randomize();
+	netB = netA;
+	auto resultA = netA.backPropagate(xorData, config);
+	auto resultB = netB.backPropagate(xorData, config);
+
+	REQUIRE(totalError(netA, xorData) < config.maxError);
+	REQUIRE(resultA.epoch == resultB.epoch);
+	REQUIRE(netA.toString() == netB.toString());
+}
+
+TEST_CASE("Hogwild XOR", "[train][hogwild]")
+{
+	TrainConfig config;
+	config.maxError = 0.001f;
+	config.learningRate = 4.f;
+	config.numThreads = 2;
+	config.hogwild = true;
+
+	NeuralNet net(2, 5, 1, 1);
+	srand(4);
+	net.randomize();
+	net.backPropagate(xorData, config);
+	REQUIRE(totalError(net, xorData) < config.maxError);
+
+	// Nothing to split between threads, and nothing to learn
+	string before = net.toString();
+	auto result = net.backPropagate(Dataset(2, 1), config);
+	REQUIRE(result.epoch == 1);
+	REQUIRE(net.toString() == before);
+}
+
+TEST_CASE("Leaky ReLU with softmax output", "[train][activation]")
+{
+	const vector<FloatVecIO> oneHotXor = {
+		{ {0, 0}, {1, 0} },
+		{ {0, 1}, {0, 1} },
+		{ {1, 0}, {0, 1} },
+		{ {1, 1}, {1, 0} }
+	};
+	TrainConfig config;
+	config.maxError = 0.01f;
+	config.learningRate = 0.1f;
+
+	NeuralNet net(2, 8, 2, 2);
+	net.setActivation(0, Activation::LeakyRelu);
+	net.setActivation(1, Activation::Tanh);
+	net.setActivation(2, Activation::Softmax);
+	srand(5);
+	net.randomize();
+	net.backPropagate(oneHotXor, config);
+
+	for (auto &vecIO : oneHotXor)
+	{
+		auto out = net.calcProb(vecIO.in);
+		REQUIRE(fabs(out[0] + out[1] - 1.f) < 1e-5f);
+		REQUIRE((out[1] > out[0]) == (vecIO.out[1] > vecIO.out[0]));
+	}
+}
+
+TEST_CASE("Resolve conflicts", "[train][dataset]")
+{
+	const vector<FloatVecIO> vals = {
+		{ {0, 1}, {0.2f, 0.9f} },
+		{ {1, 1}, {0.5f, 0.5f} },
+		{ {0, 1}, {0.7f, 0.1f} },
+		{ {-0.f, 1}, {0.3f, 1.f} }
+	};
+	auto merged = NeuralNet::resolveConflicts(vals);
+	REQUIRE(merged.size() == 2);
+	REQUIRE(merged[0].in == vals[0].in);
+	REQUIRE(merged[0].out == FloatVec({0.7f, 1.f}));
+	REQUIRE(merged[1].out == vals[1].out);
+
+	Dataset mergedData = NeuralNet::resolveConflicts(Dataset(vals));
+	REQUIRE(mergedData.size() == 2);
+	REQUIRE(FloatVec(mergedData.getOutputs(0), mergedData.getOutputs(0) + 2) == merged[0].out);
+	REQUIRE(FloatVec(mergedData.getOutputs(1), mergedData.getOutputs(1) + 2) == merged[1].out);
+}
+
+TEST_CASE("Dataset", "[train][dataset]")
+{
+	Dataset data(xorData);
+	REQUIRE(data.size() == xorData.size());
+	REQUIRE(data.getNumInputs() == 2);
+	REQUIRE(data.getNumOutputs() == 1);
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		REQUIRE(data.getInputs(i) == data.getInputs() + 2 * i);
+		REQUIRE(FloatVec(data.getInputs(i), data.getInputs(i) + 2) == xorData[i].in);
+		REQUIRE(data.getOutputs(i)[0] == xorData[i].out[0]);
+	}
+
+	vector<size_t> indices;
+	srand(3);
+	data.shuffledIndices(indices);
+	sort(indices.begin(), indices.end());
+	REQUIRE(indices == vector<size_t>({0, 1, 2, 3}));
+
+	TrainConfig config;
+	config.maxError = 0.001f;
+	config.learningRate = 4.f;
+	config.batchSize = 2;
+
+	NeuralNet fromData(2, 5, 1, 1), fromVec(2, 5, 1, 1);
+	srand(2);
+	fromData.randomize();
+	srand(2);
+	fromVec.randomize();
+	fromData.backPropagate(data, config);
+	fromVec.backPropagate(xorData, config);
+	REQUIRE(fromData.toString() == fromVec.toString());
+
+	// Same samples in a different order each epoch
+	NeuralNet shuffled(2, 5, 1, 1);
+	srand(2);
+	shuffled.randomize();
+	config.batchSize = 1;
+	config.shuffle = true;
+	shuffled.backPropagate(data, config);
+	REQUIRE(totalError(shuffled, xorData) < config.maxError);
+
+	FloatVec outputs = fromData.calcProbBatch(data);
+	REQUIRE(outputs.size() == data.size());
+	for (size_t i = 0; i < data.size(); ++i)
+		REQUIRE(outputs[i] == Approx(fromData.calcProb(xorData[i].in)[0]));
+}
+
+TEST_CASE("Training observer", "[train][observer]")
+{
+	vector<EpochStats> reports;
+	TrainConfig config;
+	config.maxError = 0.001f;
+	config.learningRate = 4.f;
+	config.observeInterval = 10;
+	config.observer = [&](const EpochStats &stats) { reports.push_back(stats); };
+
+	NeuralNet net(2, 5, 1, 1);
+	srand(2);
+	net.randomize();
+	auto result = net.backPropagate(xorData, config);
+
+	REQUIRE(reports.size() == size_t(result.epoch / 10));
+	for (size_t i = 0; i < reports.size(); ++i)
+	{
+		REQUIRE(reports[i].epoch == long(10 * (i + 1)));
+		REQUIRE(reports[i].learningRate == config.learningRate);
+		REQUIRE(reports[i].samplesPerSec >= 0);
+		if (i > 0)
+			REQUIRE(reports[i].wallTime >= reports[i - 1].wallTime);
+	}
+}
+
+TEST_CASE("Train from CSV stream", "[train][dataset]")
+{
+	const string filename = "sciod_test_data.tsv";
+	{
+		ofstream file(filename);
+		file << "label\tid\tx\ty\n";
+		for (size_t i = 0; i < xorData.size(); ++i)
+			file << xorData[i].out[0] << "\t" << i << "\t" << xorData[i].in[0] << "\t" << xorData[i].in[1] << "\n";
+		file << "\n";
+	}
+
+	ColumnSpec columns;
+	columns.inputs = {2, 3};
+	columns.outputs = {0};
+	CsvReader reader(columns, '\t', true);
+	REQUIRE(reader.open(filename));
+
+	Dataset rows;
+	REQUIRE(reader.read(rows, 3) == 3);
+	REQUIRE(reader.read(rows, 3) == 1);
+	REQUIRE(FloatVec(rows.getInputs(0), rows.getInputs(0) + 2) == xorData[3].in);
+	REQUIRE(rows.getOutputs(0)[0] == xorData[3].out[0]);
+	REQUIRE(reader.read(rows, 3) == 0);
+
+	TrainConfig config;
+	config.maxError = 0.001f;
+	config.learningRate = 4.f;
+	config.batchSize = 2;
+	config.chunkSize = 3;
+	config.resolveConflicts = false;
+
+	NeuralNet streamed(2, 5, 1, 1), inMemory(2, 5, 1, 1);
+	srand(2);
+	streamed.randomize();
+	srand(2);
+	inMemory.randomize();
+	auto streamResult = streamed.backPropagate(reader, config);
+	auto memResult = inMemory.backPropagate(xorData, config);
+	REQUIRE(streamResult.epoch == memResult.epoch);
+	REQUIRE(streamed.toString() == inMemory.toString());
+	REQUIRE(totalError(streamed, xorData) < config.maxError);
+
+	{
+		ofstream file(filename);
+		file << "label\tid\tx\ty\n0\t0\t1\t0\n1\t1\tone\t0\n";
+	}
+	REQUIRE(reader.open(filename));
+	REQUIRE_THROWS_AS(reader.read(rows, 10), const runtime_error &);
+	remove(filename.c_str());
+}
+
+TEST_CASE("Fixed topology net", "[train][fixed]")
+{
+	NeuralNet net(vector<size_t>{5, 7, 4, 3});
+	net.setActivation(0, Activation::Tanh);
+	net.setActivation(1, Activation::LeakyRelu);
+	net.setActivation(2, Activation::Softmax);
+	srand(4);
+	net.randomize();
+
+	FixedNet<5, 7, 4, 3> fixed(net);
+	REQUIRE(fixed.getActivation(1) == Activation::LeakyRelu);
+	REQUIRE(fixed.toNeuralNet().toString() == net.toString());
+
+	FixedNet<5, 7, 4, 3>::Inputs in = {{0.1f, -0.4f, 0.9f, 0.3f, -1.f}};
+	auto fixedOut = fixed.calcProb(in);
+	FloatVec netOut = net.calcProb(FloatVec(in.begin(), in.end()));
+	float maxError = 0.f;
+	for (size_t i = 0; i < fixedOut.size(); ++i)
+		maxError = max(maxError, fabs(fixedOut[i] - netOut[i]));
+	REQUIRE(maxError < 1e-5f);
+	FixedNet<5, 6, 3> wrongTopology;
+	REQUIRE_FALSE(wrongTopology.fromNeuralNet(net));
+
+	FixedNet<2, 5, 1> xorNet;
+	srand(2);
+	xorNet.randomize();
+	xorNet.backPropagate(Dataset(xorData), 0.001f, 4.f);
+	REQUIRE(totalError(xorNet.toNeuralNet(), xorData) < 0.001f);
+}
+
+TEST_CASE("Optimizers", "[train][optimizer]")
+{
+	TrainConfig sgdConfig;
+	sgdConfig.maxError = 0.001f;
+	sgdConfig.learningRate = 0.5f;
+	NeuralNet sgd(2, 5, 1, 1);
+	srand(2);
+	sgd.randomize();
+	long sgdEpochs = sgd.backPropagate(xorData, sgdConfig).epoch;
+
+	const OptimizerType types[] = {OptimizerType::Momentum, OptimizerType::Nesterov,
+								   OptimizerType::RMSProp, OptimizerType::Adam};
+	const float rates[] = {0.5f, 0.5f, 0.01f, 0.05f};
+	for (size_t i = 0; i < 4; ++i)
+	{
+		TrainConfig config = sgdConfig;
+		config.optimizer.type = types[i];
+		config.learningRate = rates[i];
+		config.batchSize = i % 2 + 1;
+		NeuralNet net(2, 5, 1, 1);
+		srand(2);
+		net.randomize();
+		long epochs = net.backPropagate(xorData, config).epoch;
+		REQUIRE(totalError(net, xorData) < config.maxError);
+		REQUIRE(epochs < sgdEpochs);
+	}
+}
+
+TEST_CASE("Optimizer state carries over between calls", "[train][optimizer]")
+{
+	TrainConfig config;
+	config.maxError = 0.f;
+	config.learningRate = 0.05f;
+	config.resolveConflicts = false;
+	config.optimizer.type = OptimizerType::Adam;
+
+	auto trainedNet = [&](const vector<long> &rounds, bool reset)
+	{
+		NeuralNet net(2, 5, 1, 1);
+		srand(2);
+		net.randomize();
+		for (long epochs : rounds)
+		{
+			if (reset)
+				net.resetOptimizer();
+			TrainConfig roundConfig = config;
+			roundConfig.maxEpochs = epochs;
+			net.backPropagate(xorData, roundConfig);
+		}
+		return net.toString();
+	};
+
+	string once = trainedNet({20}, false);
+	REQUIRE(trainedNet({10, 10}, false) == once);
+	REQUIRE(trainedNet({10, 10}, true) != once);
+
+	// Copies continue from the same state
+	NeuralNet net(2, 5, 1, 1);
+	srand(2);
+	net.randomize();
+	config.maxEpochs = 10;
+	net.backPropagate(xorData, config);
+	NeuralNet copy = net;
+	NeuralNet snapshot = Model(net).getNet();
+	net.backPropagate(xorData, config);
+	copy.backPropagate(xorData, config);
+	REQUIRE(copy.toString() == once);
+	REQUIRE(net.toString() == once);
+
+	// Snapshots keep the weights but start training afresh
+	snapshot.backPropagate(xorData, config);
+	REQUIRE(snapshot.toString() == trainedNet({10, 10}, true));
+}
+
+TEST_CASE("Training limits and early stopping", "[train][validation]")
+{
+	TrainConfig config;
+	config.maxError = 0.f;
+	config.learningRate = 4.f;
+	config.maxEpochs = 10;
+	NeuralNet net(2, 5, 1, 1);
+	srand(2);
+	net.randomize();
+	auto result = net.backPropagate(xorData, config);
+	REQUIRE(result.epoch == 10);
+	REQUIRE(result.bestEpoch == 10);
+
+	config.maxEpochs = 0;
+	config.maxSeconds = 0.05;
+	result = net.backPropagate(xorData, config);
+	REQUIRE(result.epoch > 1);
+
+	// Labels opposite to the training data only get worse as training goes on
+	vector<FloatVecIO> opposite = xorData;
+	for (auto &vecIO : opposite)
+		vecIO.out[0] = 1.f - vecIO.out[0];
+	Dataset validation(opposite);
+	config.maxSeconds = 0;
+	config.validation = &validation;
+	config.validationInterval = 2;
+	config.patience = 3;
+	NeuralNet stopped(2, 5, 1, 1);
+	srand(2);
+	stopped.randomize();
+	vector<float> losses;
+	config.observer = [&](const EpochStats &stats) { losses.push_back(stats.loss); };
+	result = stopped.backPropagate(xorData, config);
+	REQUIRE(result.bestEpoch % 2 == 0);
+	REQUIRE(result.epoch == result.bestEpoch + 6);
+	REQUIRE(fabs(totalError(stopped, opposite) - result.validationError) < 1e-6f);
+	REQUIRE(result.error == losses[result.bestEpoch - 1]);
+
+	// Stopping before the first check still scores the final weights
+	config.observer = nullptr;
+	config.validationInterval = 100;
+	config.maxEpochs = 5;
+	result = stopped.backPropagate(xorData, config);
+	REQUIRE(result.bestEpoch == 5);
+	REQUIRE(fabs(totalError(stopped, opposite) - result.validationError) < 1e-6f);
+}
+
+TEST_CASE("Trainer publishes model snapshots", "[train][model]")
+{
+	NeuralNet net(2, 5, 1, 1);
+	srand(2);
+	net.randomize();
+	Trainer trainer(net);
+	ModelPtr initial = trainer.getModel();
+	REQUIRE(initial->getVersion() == 0);
+	REQUIRE(initial->getNet().toString() == net.toString());
+
+	// Readers only ever see complete snapshots, in publishing order
+	atomic<bool> done(false), ordered(true), complete(true);
+	vector<thread> readers;
+	for (size_t i = 0; i < 3; ++i)
+		readers.emplace_back([&]
+		{
+			Workspace workspace(initial->getNet());
+			long lastVersion = 0;
+			while (!done)
+			{
+				ModelPtr model = trainer.getModel();
+				if (model->getVersion() < lastVersion)
+					ordered = false;
+				if (model->getNumInputs() != 2 || model->getNumOutputs() != 1)
+					complete = false;
+				lastVersion = model->getVersion();
+				float out;
+				model->calcProb(xorData[1].in.data(), &out, workspace);
+			}
+		});
+
+	TrainConfig config;
+	config.learningRate = 4.f;
+	long reports = 0;
+	config.observeInterval = 100;
+	config.observer = [&](const EpochStats &stats)
+	{
+		reports += stats.epoch % 100 == 0;
+	};
+	trainer.setPublishInterval(50);
+	auto result = trainer.train(Dataset(xorData), config);
+	done = true;
+	for (auto &reader : readers)
+		reader.join();
+
+	REQUIRE(ordered);
+	REQUIRE(complete);
+	REQUIRE(reports == result.epoch / 100);
+	ModelPtr latest = trainer.getModel();
+	REQUIRE(latest->getVersion() == result.epoch / 50 + 1);
+	REQUIRE(latest->getNet().toString() == trainer.getNet().toString());
+	REQUIRE(totalError(latest->getNet(), xorData) < config.maxError);
+	REQUIRE(initial->getNet().toString() == net.toString());
+}
+
+TEST_CASE("Training allocates nothing per sample", "[train][alloc]")
+{
+	Dataset data(2, 1);
+	srand(5);
+	for (size_t i = 0; i < 64; ++i)
+	{
+		float x = float(rand()) / RAND_MAX, y = float(rand()) / RAND_MAX;
+		data.addRow(FloatVec{x, y}, FloatVec{x * y});
+	}
+
+	// Setup costs the same however long training runs, so any
+	// difference comes from the batches and epochs themselves
+	auto countAllocations = [&](TrainConfig config, long epochs)
+	{
+		NeuralNet net(2, 8, 2, 1);
+		srand(3);
+		net.randomize();
+		config.maxError = 0.f;
+		config.learningRate = 0.1f;
+		config.resolveConflicts = false;
+		config.maxEpochs = epochs;
+		size_t before = numAllocations;
+		long epochsRun = net.backPropagate(data, config).epoch;
+		size_t count = numAllocations - before;
+
+		// Checked by the caller, as REQUIRE itself allocates
+		return epochsRun == epochs ? count : 0;
+	};
+
+	TrainConfig online, shuffled, batch, pooled, hogwild, adam;
+	shuffled.shuffle = true;
+	batch.batchSize = 8;
+	pooled.batchSize = 8;
+	pooled.numThreads = 2;
+	hogwild.hogwild = true;
+	hogwild.numThreads = 2;
+	adam.optimizer.type = OptimizerType::Adam;
+	for (const TrainConfig &config : {online, shuffled, batch, pooled, hogwild, adam})
+	{
+		size_t shortRun = countAllocations(config, 1);
+		size_t longRun = countAllocations(config, 20);
+		REQUIRE(shortRun > 0);
+		REQUIRE(longRun == shortRun);
+	}
+}